@@ -23,10 +23,16 @@
 #include <functional>
 #include <fstream>
 #include <unordered_set>
-#include <cstring>
-#include <libgen.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <cstdio>
+#include <cstdlib>
 
 #include <Librarian/Index.hh>
+#include <Librarian/IndexDirectory.hh>
+#include <Librarian/IndexBuilder.hh>
+#include <Librarian/SegmentMerger.hh>
 #include <Librarian/Tokenizer.hh>
 #include <Librarian/Normalizer.hh>
 
@@ -37,10 +43,14 @@ namespace Param
 {
   enum Params
   {
-    Help    = 0,
-    Create  = 1,
-    Add     = 2,
-    Invalid = 3
+    Help     = 0,
+    Create   = 1,
+    Add      = 2,
+    Import   = 3,
+    Export   = 4,
+    Merge    = 5,
+    Optimize = 6,
+    Invalid  = 7
   };
 }
 
@@ -67,12 +77,40 @@ Param::Params processCommandLine( std::vector<std::string>  &params,
   }
 
   if( command == "add" )
+  {
+    int first = 2;
+    params.push_back( "0" );
+    if( argc > 3 && std::string( argv[2] ) == "-j" )
+    {
+      char *end;
+      unsigned long threads = strtoul( argv[3], &end, 10 );
+      if( *end || !*argv[3] || !threads )
+        return Param::Invalid;
+      params[0] = argv[3];
+      first = 4;
+    }
+    if( argc < first+2 )
+      return Param::Invalid;
+    for( int i = first; i < argc; ++i )
+      params.push_back( argv[i] );
+    return Param::Add;
+  }
+
+  if( command == "import" || command == "export" )
   {
     if( argc != 4 )
       return Param::Invalid;
     params.push_back( argv[2] );
     params.push_back( argv[3] );
-    return Param::Add;
+    return command == "import" ? Param::Import : Param::Export;
+  }
+
+  if( command == "merge" || command == "optimize" )
+  {
+    if( argc != 3 )
+      return Param::Invalid;
+    params.push_back( argv[2] );
+    return command == "merge" ? Param::Merge : Param::Optimize;
   }
   return Param::Invalid;
 }
@@ -84,8 +122,22 @@ int help( const std::vector<std::string> &params )
 {
   std::cerr << "Usage:" << std::endl;
   std::cerr << "   help                print this help message" << std::endl;
-  std::cerr << "   create filename     create a new index file" << std::endl;
-  std::cerr << "   add index filename  add a new file to index" << std::endl;
+  std::cerr << "   create index        create a new index directory" << std::endl;
+  std::cerr << "   add [-j threads] index path..." << std::endl;
+  std::cerr << "                       add files, directory trees or, for '-',";
+  std::cerr << std::endl;
+  std::cerr << "                       a NUL-separated list of paths from stdin";
+  std::cerr << std::endl;
+  std::cerr << "                       using a thread per core by default";
+  std::cerr << std::endl;
+  std::cerr << "   import text index   create an index from a text dump";
+  std::cerr << std::endl;
+  std::cerr << "   export index text   dump an index to a text file";
+  std::cerr << std::endl;
+  std::cerr << "   merge index         merge segments as the policy says";
+  std::cerr << std::endl;
+  std::cerr << "   optimize index      merge all the segments into one";
+  std::cerr << std::endl;
   return 0;
 }
 
@@ -94,90 +146,323 @@ int help( const std::vector<std::string> &params )
 //------------------------------------------------------------------------------
 int create( const std::vector<std::string> &params )
 {
-  std::ofstream o(params[0]);
-  if( !o.good() )
+  Librarian::Status st = Librarian::IndexDirectory::create( params[0] );
+  if( !st.isOK() )
   {
-    std::cerr << "Unable to open: " << params[0] << std::endl;
+    std::cerr << "Unable to create " << params[0] << ": ";
+    std::cerr << st.toString() << std::endl;
     return 1;
   }
-  o << 0 << std::endl;
-  o << 0 << std::endl;
   return 0;
 }
 
 //------------------------------------------------------------------------------
-// Add new item to the index
+// Amount of input indexed in memory before a segment is written; it is
+// measured in file sizes, known up front, so that the segments do not depend
+// on the number of threads
+//------------------------------------------------------------------------------
+const uint64_t SegmentBytes = 256 << 20;
+
+//------------------------------------------------------------------------------
+// Ingestion progress
+//------------------------------------------------------------------------------
+class Progress
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    Progress( size_t total ):
+      pTotal( total ), pStart( Clock::now() ), pLast( pStart ) {}
+
+    //--------------------------------------------------------------------------
+    // Account for a processed document and report at most once per second
+    //--------------------------------------------------------------------------
+    void update( uint64_t bytes, uint64_t tokens )
+    {
+      ++pFiles;
+      pBytes  += bytes;
+      pTokens += tokens;
+      Clock::time_point now = Clock::now();
+      if( now - pLast < std::chrono::seconds( 1 ) )
+        return;
+      pLast = now;
+      report( "Processed" );
+    }
+
+    void fail() { ++pFailed; }
+
+    uint64_t failed() const { return pFailed; }
+
+    //--------------------------------------------------------------------------
+    // Print the counters and the throughput
+    //--------------------------------------------------------------------------
+    void report( const char *what ) const
+    {
+      double secs = std::chrono::duration<double>( Clock::now()-pStart ).count();
+      double mb   = pBytes/1048576.0;
+      double rate = secs > 0 ? 1/secs : 0;
+      char   buf[256];
+      snprintf( buf, sizeof(buf),
+                "%s %llu/%llu files, %llu tokens, %.1f MB in %.1fs "
+                "(%.1f files/s, %.2f MB/s)",
+                what, (unsigned long long)pFiles, (unsigned long long)pTotal,
+                (unsigned long long)pTokens, mb, secs, pFiles*rate, mb*rate );
+      std::cerr << buf;
+      if( pFailed )
+        std::cerr << ", " << pFailed << " failed";
+      std::cerr << std::endl;
+    }
+
+  private:
+    uint64_t          pTotal;
+    uint64_t          pFiles  = 0;
+    uint64_t          pFailed = 0;
+    uint64_t          pBytes  = 0;
+    uint64_t          pTokens = 0;
+    Clock::time_point pStart;
+    Clock::time_point pLast;
+};
+
+//------------------------------------------------------------------------------
+// Expand a path: directories are walked recursively and their regular files
+// are taken in name order so that the document ids are reproducible
+//------------------------------------------------------------------------------
+bool expandPath( const std::string &path, std::vector<std::string> &files )
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if( !fs::is_directory( path, ec ) )
+  {
+    files.push_back( path );
+    return true;
+  }
+
+  std::vector<std::string> found;
+  fs::recursive_directory_iterator it( path,
+    fs::directory_options::skip_permission_denied, ec ), end;
+  for( ; !ec && it != end; it.increment( ec ) )
+    if( it->is_regular_file( ec ) )
+      found.push_back( it->path().string() );
+  if( ec )
+  {
+    std::cerr << "Unable to list " << path << ": " << ec.message();
+    std::cerr << std::endl;
+    return false;
+  }
+  std::sort( found.begin(), found.end() );
+  files.insert( files.end(), found.begin(), found.end() );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Collect the input files, "-" stands for a NUL-separated list on stdin
+//------------------------------------------------------------------------------
+bool collectInputs( const std::vector<std::string> &args,
+                    std::vector<std::string>       &files )
+{
+  bool ok = true;
+  for( auto &arg: args )
+  {
+    if( arg != "-" )
+    {
+      ok &= expandPath( arg, files );
+      continue;
+    }
+    std::string path;
+    while( std::getline( std::cin, path, '\0' ) )
+      if( !path.empty() )
+        ok &= expandPath( path, files );
+  }
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+// Add new items to the index
 //------------------------------------------------------------------------------
 int add( const std::vector<std::string> &params )
 {
   using namespace Librarian;
 
   //----------------------------------------------------------------------------
-  // Load the index
+  // Figure out what to index
   //----------------------------------------------------------------------------
-  std::cerr << "Loading the index... " << std::flush;
-  Index index;
-  Status st = index.load( params[0] );
+  std::vector<std::string> files;
+  bool inputOK = collectInputs(
+    std::vector<std::string>( params.begin()+2, params.end() ), files );
+
+  //----------------------------------------------------------------------------
+  // Open the index
+  //----------------------------------------------------------------------------
+  const std::string &path = params[1];
+  IndexDirectory     dir;
+  Status st = dir.open( path, true );
   if( !st.isOK() )
   {
-    std::cerr << "Unable to load index from " << params[0] << ": ";
+    std::cerr << "Unable to open index " << path << ": ";
     std::cerr << st.toString() << std::endl;
     return 2;
   }
-  std::cerr << "Done." << std::endl;
+
+  SegmentMerger merger( &dir );
+  Progress      progress( files.size() );
+  IndexBuilder  builder( std::stoul( params[0] ) );
+  builder.setCallback( [&]( const std::string            &file,
+                            const IndexBuilder::Document &doc )
+  {
+    if( !doc.status.isOK() )
+    {
+      std::cerr << "Unable to process " << file << ": ";
+      std::cerr << doc.status.toString() << std::endl;
+      progress.fail();
+      return;
+    }
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size( file, ec );
+    progress.update( ec ? 0 : size, doc.tokens );
+  } );
 
   //----------------------------------------------------------------------------
-  // Open the input
+  // Index the files in runs of SegmentBytes, every run becomes a segment
+  //----------------------------------------------------------------------------
+  std::vector<IndexBuilder::Document> docs;
+  for( size_t first = 0; first < files.size() && st.isOK(); )
+  {
+    size_t   last  = first;
+    uint64_t bytes = 0;
+    while( last < files.size() && (last == first || bytes < SegmentBytes) )
+    {
+      std::error_code ec;
+      uint64_t size = std::filesystem::file_size( files[last++], ec );
+      bytes += ec ? 0 : size;
+    }
+
+    Index index;
+    index.setNextDocId( dir.getNextDocId() );
+    builder.build( index,
+                   std::vector<std::string>( files.begin()+first,
+                                             files.begin()+last ),
+                   docs );
+    st = dir.addSegment( index );
+    if( st.isOK() )
+      merger.startBackground( MergePolicy() );
+    first = last;
+  }
+
   //----------------------------------------------------------------------------
-  std::cerr << "Processing " << params[1] << "... " << std::flush;
-  FileTokenizer t;
-  st = t.open( params[1] );
+  // Let the merges finish
+  //----------------------------------------------------------------------------
+  Status merged = merger.wait();
   if( !st.isOK() )
   {
+    std::cerr << "Unable to store a segment in " << path << ": ";
     std::cerr << st.toString() << std::endl;
-    return 3;
+    return 5;
   }
+  progress.report( "Done:" );
+  if( !merged.isOK() )
+  {
+    std::cerr << "Unable to merge segments: " << merged.toString() << std::endl;
+    return 5;
+  }
+  return inputOK && !progress.failed() ? 0 : 3;
+}
 
-  char *nameBuf = new char[params[1].size()+1];
-  nameBuf[params[1].size()] = 0;
-  memcpy( nameBuf, params[1].c_str(), params[1].size() );
-  char *name = basename( nameBuf );
-  docid_t docId = index.registerDocument( name );
-  delete [] nameBuf;
+//------------------------------------------------------------------------------
+// Create an index from a text dump
+//------------------------------------------------------------------------------
+int import( const std::vector<std::string> &params )
+{
+  using namespace Librarian;
+  Index  index;
+  Status st = index.importText( params[0] );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to import index from " << params[0] << ": ";
+    std::cerr << st.toString() << std::endl;
+    return 2;
+  }
 
-  EnglishNormalizer norm;
-  std::unordered_set<std::string> tokens;
-  int count = 0;
-  while( t.loadNextToken() )
+  IndexDirectory dir;
+  st = IndexDirectory::create( params[1] );
+  if( st.isOK() )
+    st = dir.open( params[1], true );
+  if( st.isOK() )
+    st = dir.addSegment( index );
+  if( !st.isOK() )
   {
-    std::string token = norm.normalize(t.getToken());
-    if( token.empty() )
-      continue;
-    tokens.insert( token );
-    ++count;
+    std::cerr << "Unable to store the index to " << params[1] << ": ";
+    std::cerr << st.toString() << std::endl;
+    return 5;
   }
+  return 0;
+}
 
-  for( auto it = tokens.begin(); it != tokens.end(); ++it )
-    index.addPosting( *it, docId );
+//------------------------------------------------------------------------------
+// Dump an index to a text file
+//------------------------------------------------------------------------------
+int exportText( const std::vector<std::string> &params )
+{
+  using namespace Librarian;
+  Index          index;
+  IndexDirectory dir;
+  Status st = dir.open( params[0] );
+  if( st.isOK() )
+    st = dir.loadAll( index );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to load index from " << params[0] << ": ";
+    std::cerr << st.toString() << std::endl;
+    return 2;
+  }
 
-  std::cerr << "Processed " << count << " tokens, unique: " << tokens.size();
-  std::cerr << "." << std::endl;
+  st = index.exportText( params[1] );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to export the index to " << params[1] << ": ";
+    std::cerr << st.toString() << std::endl;
+    return 5;
+  }
+  return 0;
+}
 
-  //----------------------------------------------------------------------------
-  // Clean up
-  //----------------------------------------------------------------------------
-  std::cerr << "Storing the index to " << params[0] << "... " << std::flush;
-  t.close();
-  st = index.dump( params[0] );
+//------------------------------------------------------------------------------
+// Merge the segments of an index
+//------------------------------------------------------------------------------
+int runMerge( const std::string &path, bool all )
+{
+  using namespace Librarian;
+  IndexDirectory dir;
+  Status st = dir.open( path, true );
   if( !st.isOK() )
   {
+    std::cerr << "Unable to open index " << path << ": ";
     std::cerr << st.toString() << std::endl;
+    return 2;
+  }
+
+  size_t        before = dir.getSnapshot().size();
+  SegmentMerger merger( &dir );
+  st = all ? merger.optimize() : merger.maybeMerge( MergePolicy() );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to merge segments: " << st.toString() << std::endl;
     return 5;
   }
-  std::cerr << "Done." << std::endl;
+  std::cerr << "Segments: " << before << " -> " << dir.getSnapshot().size();
+  std::cerr << std::endl;
   return 0;
 }
 
+int merge( const std::vector<std::string> &params )
+{
+  return runMerge( params[0], false );
+}
+
+int optimize( const std::vector<std::string> &params )
+{
+  return runMerge( params[0], true );
+}
+
 //------------------------------------------------------------------------------
 // The main show
 //------------------------------------------------------------------------------
@@ -196,6 +481,10 @@ int main( int argc, char **argv )
   commands.push_back( help );
   commands.push_back( create );
   commands.push_back( add  );
+  commands.push_back( import );
+  commands.push_back( exportText );
+  commands.push_back( merge );
+  commands.push_back( optimize );
 
   if( p >= commands.size() )
   {
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include <Librarian/IntersectionKernels.hh>
+
+using Librarian::docid_t;
+using Librarian::IntersectionKernels;
+
+typedef std::function<size_t( const docid_t*, size_t, const docid_t*, size_t,
+                              docid_t* )> Kernel;
+
+//------------------------------------------------------------------------------
+// Draw a sorted list of unique ids out of [1, universe]
+//------------------------------------------------------------------------------
+std::vector<docid_t> makeList( std::mt19937_64 &rng, size_t size,
+                               docid_t universe )
+{
+  std::vector<docid_t> ids;
+  std::uniform_int_distribution<docid_t> dist( 1, universe );
+  while( ids.size() < size )
+  {
+    while( ids.size() < size )
+      ids.push_back( dist( rng ) );
+    std::sort( ids.begin(), ids.end() );
+    ids.erase( std::unique( ids.begin(), ids.end() ), ids.end() );
+  }
+  return ids;
+}
+
+//------------------------------------------------------------------------------
+// Best time of a kernel over a number of runs, in milliseconds
+//------------------------------------------------------------------------------
+double measure( const Kernel               &kernel,
+                const std::vector<docid_t> &a,
+                const std::vector<docid_t> &b,
+                int                         runs,
+                size_t                     &found )
+{
+  std::vector<docid_t> out( std::min( a.size(), b.size() ) );
+  double best = 1e100;
+  for( int i = 0; i < runs; ++i )
+  {
+    auto start = std::chrono::steady_clock::now();
+    found = kernel( a.data(), a.size(), b.data(), b.size(), out.data() );
+    auto end   = std::chrono::steady_clock::now();
+    best = std::min( best, std::chrono::duration<double, std::milli>(
+                             end - start ).count() );
+  }
+  return best;
+}
+
+//------------------------------------------------------------------------------
+// The main show
+//------------------------------------------------------------------------------
+int main( int argc, char **argv )
+{
+  if( argc > 3 || (argc > 1 && std::string( argv[1] ) == "help") )
+  {
+    std::cerr << "Usage: " << argv[0] << " [long-list-size [runs]]";
+    std::cerr << std::endl;
+    std::cerr << "  intersect a long list with shorter ones over a sweep";
+    std::cerr << " of size ratios" << std::endl;
+    return 1;
+  }
+
+  size_t longSize = argc > 1 ? std::stoull( argv[1] ) : 2000000;
+  int    runs     = argc > 2 ? std::stoi( argv[2] ) : 7;
+
+  std::vector<std::pair<std::string, Kernel>> kernels = {
+    { "merge",  IntersectionKernels::merge },
+    { "block",  IntersectionKernels::block },
+    { "gallop", IntersectionKernels::gallop },
+    { "auto",   IntersectionKernels::intersect } };
+
+  //----------------------------------------------------------------------------
+  // The long list takes a quarter of the id space, the short ones are
+  // drawn independently from it
+  //----------------------------------------------------------------------------
+  std::mt19937_64      rng( 42 );
+  docid_t              universe = 4*longSize;
+  std::vector<docid_t> b        = makeList( rng, longSize, universe );
+
+  std::cout << "block kernel: " << IntersectionKernels::kernelName();
+  std::cout << ", gallop ratio: " << IntersectionKernels::GallopRatio;
+  std::cout << ", long list: " << longSize << ", best of " << runs;
+  std::cout << std::endl << std::endl;
+  std::cout << std::setw( 8 ) << "ratio";
+  for( auto &k: kernels )
+    std::cout << std::setw( 12 ) << k.first;
+  std::cout << std::endl;
+
+  for( size_t ratio: { 1, 2, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 } )
+  {
+    if( longSize / ratio == 0 )
+      break;
+    std::vector<docid_t> a = makeList( rng, longSize/ratio, universe );
+    std::cout << std::setw( 6 ) << ratio << ":1";
+
+    size_t expected = 0;
+    for( size_t i = 0; i < kernels.size(); ++i )
+    {
+      size_t found = 0;
+      double time  = measure( kernels[i].second, a, b, runs, found );
+      if( i == 0 )
+        expected = found;
+      else if( found != expected )
+      {
+        std::cerr << std::endl << kernels[i].first << " found " << found;
+        std::cerr << " ids instead of " << expected << std::endl;
+        return 2;
+      }
+      std::cout << std::setw( 10 ) << std::fixed << std::setprecision( 3 );
+      std::cout << time << "ms";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+
+#include <Librarian/Bitmap.hh>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Mask of the bits [begin, end) of a word, end may be 64
+  //----------------------------------------------------------------------------
+  inline uint64_t mask( uint32_t begin, uint32_t end )
+  {
+    uint64_t hi = end == 64 ? ~(uint64_t)0 : ((uint64_t)1 << end) - 1;
+    return hi & (~(uint64_t)0 << begin);
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Set all the bits in [begin, end)
+  //----------------------------------------------------------------------------
+  void Bitmap::setRange( uint64_t begin, uint64_t end )
+  {
+    end = std::min( end, pSize );
+    if( begin >= end )
+      return;
+
+    size_t first = begin/64, last = (end-1)/64;
+    if( first == last )
+    {
+      pWords[first] |= mask( begin%64, (end-1)%64+1 );
+      return;
+    }
+    pWords[first] |= mask( begin%64, 64 );
+    for( size_t i = first+1; i < last; ++i )
+      pWords[i] = ~(uint64_t)0;
+    pWords[last] |= mask( 0, (end-1)%64+1 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Flip all the bits in [begin, end)
+  //----------------------------------------------------------------------------
+  void Bitmap::flip( uint64_t begin, uint64_t end )
+  {
+    end = std::min( end, pSize );
+    if( begin >= end )
+      return;
+
+    size_t first = begin/64, last = (end-1)/64;
+    if( first == last )
+    {
+      pWords[first] ^= mask( begin%64, (end-1)%64+1 );
+      return;
+    }
+    pWords[first] ^= mask( begin%64, 64 );
+    for( size_t i = first+1; i < last; ++i )
+      pWords[i] = ~pWords[i];
+    pWords[last] ^= mask( 0, (end-1)%64+1 );
+  }
+
+  //----------------------------------------------------------------------------
+  // OR the words in at the given word offset
+  //----------------------------------------------------------------------------
+  void Bitmap::orWords( size_t offset, const void *words, size_t num )
+  {
+    if( offset >= pWords.size() )
+      return;
+    num = std::min( num, pWords.size()-offset );
+    uint64_t      *out = pWords.data() + offset;
+    const uint8_t *in  = (const uint8_t *)words;
+    for( size_t i = 0; i < num; ++i )
+    {
+      uint64_t w;
+      memcpy( &w, in+8*i, 8 );
+      out[i] |= w;
+    }
+
+    //--------------------------------------------------------------------------
+    // Do not let the bits past the size leak in
+    //--------------------------------------------------------------------------
+    if( offset+num == pWords.size() && pSize%64 )
+      pWords.back() &= mask( 0, pSize%64 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Intersect with another bitmap
+  //----------------------------------------------------------------------------
+  void Bitmap::andWith( const Bitmap &other )
+  {
+    size_t num = std::min( pWords.size(), other.pWords.size() );
+    uint64_t       *out = pWords.data();
+    const uint64_t *in  = other.pWords.data();
+    for( size_t i = 0; i < num; ++i )
+      out[i] &= in[i];
+    std::fill( pWords.begin()+num, pWords.end(), 0 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Sum with another bitmap
+  //----------------------------------------------------------------------------
+  void Bitmap::orWith( const Bitmap &other )
+  {
+    orWords( 0, other.pWords.data(), other.pWords.size() );
+  }
+
+  //----------------------------------------------------------------------------
+  // Remove the bits set in the other bitmap
+  //----------------------------------------------------------------------------
+  void Bitmap::andNotWith( const Bitmap &other )
+  {
+    size_t num = std::min( pWords.size(), other.pWords.size() );
+    uint64_t       *out = pWords.data();
+    const uint64_t *in  = other.pWords.data();
+    for( size_t i = 0; i < num; ++i )
+      out[i] &= ~in[i];
+  }
+
+  //----------------------------------------------------------------------------
+  // Count the bits that are set
+  //----------------------------------------------------------------------------
+  uint64_t Bitmap::count() const
+  {
+    uint64_t cnt = 0;
+    for( auto w: pWords )
+      cnt += __builtin_popcountll( w );
+    return cnt;
+  }
+}
@@ -0,0 +1,168 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Dense set of document ids, one bit per id
+  //----------------------------------------------------------------------------
+  class Bitmap
+  {
+    public:
+      static const uint64_t npos = (uint64_t)-1;
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param size number of bits, all of them cleared
+      //------------------------------------------------------------------------
+      Bitmap( uint64_t size = 0 ):
+        pWords( (size+63)/64, 0 ), pSize( size ) {}
+
+      //------------------------------------------------------------------------
+      //! Number of bits
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pSize;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of words
+      //------------------------------------------------------------------------
+      size_t numWords() const
+      {
+        return pWords.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Access the words
+      //------------------------------------------------------------------------
+      uint64_t *words()
+      {
+        return pWords.data();
+      }
+
+      //------------------------------------------------------------------------
+      //! Access the words
+      //------------------------------------------------------------------------
+      const uint64_t *words() const
+      {
+        return pWords.data();
+      }
+
+      //------------------------------------------------------------------------
+      //! Set a bit
+      //------------------------------------------------------------------------
+      void set( uint64_t bit )
+      {
+        pWords[bit/64] |= (uint64_t)1 << (bit%64);
+      }
+
+      //------------------------------------------------------------------------
+      //! Clear a bit
+      //------------------------------------------------------------------------
+      void clear( uint64_t bit )
+      {
+        pWords[bit/64] &= ~((uint64_t)1 << (bit%64));
+      }
+
+      //------------------------------------------------------------------------
+      //! Test a bit
+      //------------------------------------------------------------------------
+      bool test( uint64_t bit ) const
+      {
+        return pWords[bit/64] & ((uint64_t)1 << (bit%64));
+      }
+
+      //------------------------------------------------------------------------
+      //! Set all the bits in [begin, end)
+      //------------------------------------------------------------------------
+      void setRange( uint64_t begin, uint64_t end );
+
+      //------------------------------------------------------------------------
+      //! OR the words in at the given word offset, the words do not need to
+      //! be aligned
+      //------------------------------------------------------------------------
+      void orWords( size_t offset, const void *words, size_t num );
+
+      //------------------------------------------------------------------------
+      //! Intersect with another bitmap
+      //------------------------------------------------------------------------
+      void andWith( const Bitmap &other );
+
+      //------------------------------------------------------------------------
+      //! Sum with another bitmap
+      //------------------------------------------------------------------------
+      void orWith( const Bitmap &other );
+
+      //------------------------------------------------------------------------
+      //! Remove the bits set in the other bitmap
+      //------------------------------------------------------------------------
+      void andNotWith( const Bitmap &other );
+
+      //------------------------------------------------------------------------
+      //! Flip all the bits in [begin, end)
+      //------------------------------------------------------------------------
+      void flip( uint64_t begin, uint64_t end );
+
+      //------------------------------------------------------------------------
+      //! Count the bits that are set
+      //------------------------------------------------------------------------
+      uint64_t count() const;
+
+      //------------------------------------------------------------------------
+      //! Find the first set bit not smaller than the given one
+      //!
+      //! @return npos if there is none
+      //------------------------------------------------------------------------
+      uint64_t next( uint64_t bit ) const
+      {
+        if( bit >= pSize )
+          return npos;
+        size_t   word = bit/64;
+        uint64_t bits = pWords[word] & (~(uint64_t)0 << (bit%64));
+        while( !bits )
+        {
+          if( ++word == pWords.size() )
+            return npos;
+          bits = pWords[word];
+        }
+        return word*64 + __builtin_ctzll( bits );
+      }
+
+      //------------------------------------------------------------------------
+      //! Memory used by the bitmap in bytes
+      //------------------------------------------------------------------------
+      size_t memoryUsage() const
+      {
+        return pWords.capacity()*sizeof(uint64_t);
+      }
+
+    private:
+      std::vector<uint64_t> pWords;
+      uint64_t              pSize;
+  };
+}
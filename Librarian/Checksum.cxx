@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cstring>
+
+#include <Librarian/Checksum.hh>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LIBRARIAN_X86_64 1
+#endif
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Lookup table for the reflected polynomial, one byte at a time
+  //----------------------------------------------------------------------------
+  struct Table
+  {
+    Table()
+    {
+      for( uint32_t i = 0; i < 256; ++i )
+      {
+        uint32_t crc = i;
+        for( int k = 0; k < 8; ++k )
+          crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+        entries[i] = crc;
+      }
+    }
+    uint32_t entries[256];
+  };
+  const Table gTable;
+
+  //----------------------------------------------------------------------------
+  // Scalar implementation
+  //----------------------------------------------------------------------------
+  uint32_t updateScalar( uint32_t crc, const uint8_t *data, size_t length )
+  {
+    for( size_t i = 0; i < length; ++i )
+      crc = gTable.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+  }
+
+#ifdef LIBRARIAN_X86_64
+  //----------------------------------------------------------------------------
+  // SSE4.2 implementation, eight bytes at a time
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse4.2")))
+  uint32_t updateSSE42( uint32_t crc, const uint8_t *data, size_t length )
+  {
+    uint64_t acc = crc;
+    for( ; length >= 8; length -= 8, data += 8 )
+    {
+      uint64_t word;
+      memcpy( &word, data, 8 );
+      acc = _mm_crc32_u64( acc, word );
+    }
+    crc = acc;
+    for( ; length; --length, ++data )
+      crc = _mm_crc32_u8( crc, *data );
+    return crc;
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  // Pick the implementation for the CPU we run on
+  //----------------------------------------------------------------------------
+  typedef uint32_t (*UpdateFn)( uint32_t, const uint8_t*, size_t );
+
+  struct Implementation
+  {
+    Implementation()
+    {
+#ifdef LIBRARIAN_X86_64
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "sse4.2" ) )
+      {
+        function = updateSSE42;
+        name     = "sse4.2";
+      }
+#endif
+    }
+    UpdateFn    function = updateScalar;
+    const char *name     = "scalar";
+  };
+  const Implementation gImplementation;
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Extend a checksum with more data
+  //----------------------------------------------------------------------------
+  uint32_t Checksum::update( uint32_t crc, const void *data, size_t length )
+  {
+    return ~gImplementation.function( ~crc, (const uint8_t *)data, length );
+  }
+
+  //----------------------------------------------------------------------------
+  // Name of the implementation
+  //----------------------------------------------------------------------------
+  const char *Checksum::implementationName()
+  {
+    return gImplementation.name;
+  }
+}
@@ -0,0 +1,44 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! CRC-32C (Castagnoli) checksums; the SSE4.2 crc32 instruction is used
+  //! when the CPU has it
+  //----------------------------------------------------------------------------
+  class Checksum
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Extend a checksum with more data, start with 0
+      //------------------------------------------------------------------------
+      static uint32_t update( uint32_t crc, const void *data, size_t length );
+
+      //------------------------------------------------------------------------
+      //! Name of the implementation selected for this CPU
+      //------------------------------------------------------------------------
+      static const char *implementationName();
+  };
+}
@@ -0,0 +1,152 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include <Librarian/DocumentTable.hh>
+#include <Librarian/Bitmap.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Add a document
+  //----------------------------------------------------------------------------
+  bool DocumentTable::add( docid_t id, std::string_view name )
+  {
+    if( !id || name.empty() || (pFirstId && id < endId()) )
+      return false;
+    extend( id );
+    pNames.append( name );
+    pOffsets.push_back( pNames.size() );
+    ++pCount;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Move in the documents of another table
+  //----------------------------------------------------------------------------
+  bool DocumentTable::append( DocumentTable &other )
+  {
+    if( !other.pFirstId )
+      return true;
+    if( pFirstId && other.pFirstId < endId() )
+      return false;
+    extend( other.pFirstId );
+
+    uint64_t base = pNames.size();
+    pNames.append( other.pNames );
+    pOffsets.reserve( pOffsets.size() + other.pOffsets.size()-1 );
+    for( size_t i = 1; i < other.pOffsets.size(); ++i )
+      pOffsets.push_back( base + other.pOffsets[i] );
+    pCount += other.pCount;
+    other.clear();
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Copy in a table stored in an index file
+  //----------------------------------------------------------------------------
+  bool DocumentTable::assign( docid_t         firstId,
+                              const uint64_t *offsets,
+                              uint64_t        numIds,
+                              const char     *names,
+                              uint64_t        length )
+  {
+    clear();
+    if( !numIds )
+      return true;
+    if( !firstId || offsets[0] != 0 || offsets[numIds] > length )
+      return false;
+
+    uint64_t count = 0;
+    for( uint64_t i = 0; i < numIds; ++i )
+    {
+      if( offsets[i+1] < offsets[i] )
+        return false;
+      count += offsets[i+1] != offsets[i];
+    }
+
+    pFirstId = firstId;
+    pCount   = count;
+    pOffsets.assign( offsets, offsets+numIds+1 );
+    pNames.assign( names, offsets[numIds] );
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Remove all the documents
+  //----------------------------------------------------------------------------
+  void DocumentTable::clear()
+  {
+    pFirstId = 0;
+    pCount   = 0;
+    pOffsets.assign( 1, 0 );
+    pNames.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  // Get the first document with an id larger than the given one
+  //----------------------------------------------------------------------------
+  docid_t DocumentTable::next( docid_t id ) const
+  {
+    docid_t end = endId();
+    for( id = std::max( id+1, pFirstId ); id < end; ++id )
+      if( pOffsets[id-pFirstId+1] != pOffsets[id-pFirstId] )
+        return id;
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the bits of all the documents of a table
+  //----------------------------------------------------------------------------
+  void DocumentTable::fill( Bitmap         &bitmap,
+                            docid_t         firstId,
+                            const uint64_t *offsets,
+                            uint64_t        numIds,
+                            uint64_t        numDocuments )
+  {
+    if( numDocuments == numIds )
+    {
+      bitmap.setRange( firstId, firstId+numIds );
+      return;
+    }
+
+    uint64_t i = 0;
+    while( i < numIds )
+    {
+      while( i < numIds && offsets[i+1] == offsets[i] )
+        ++i;
+      uint64_t begin = i;
+      while( i < numIds && offsets[i+1] != offsets[i] )
+        ++i;
+      if( begin != i )
+        bitmap.setRange( firstId+begin, firstId+i );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Cover the ids up to the given one with empty names
+  //----------------------------------------------------------------------------
+  void DocumentTable::extend( docid_t id )
+  {
+    if( !pFirstId )
+      pFirstId = id;
+    pOffsets.resize( id - pFirstId + 1, pNames.size() );
+  }
+}
@@ -0,0 +1,201 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Librarian/PostingCodec.hh>
+
+namespace Librarian
+{
+  class Bitmap;
+
+  //----------------------------------------------------------------------------
+  //! Names of the documents of an index, indexed by the document id
+  //!
+  //! The table covers a dense range of ids starting with the first document
+  //! it holds. The names are packed one after another in a single blob and
+  //! an array of offsets, one per id plus the end of the blob, tells where
+  //! each of them is, so a lookup takes two reads. The ids that are not in
+  //! use have empty names, so a document cannot have an empty name, and
+  //! they still take an offset each, so the range of the ids should be
+  //! dense. This is also the layout of the document sections of the index
+  //! files, so the table is written and read back as it is.
+  //----------------------------------------------------------------------------
+  class DocumentTable
+  {
+    public:
+      //! Number of the ids a table may cover regardless of how many of them
+      //! are in use
+      static const uint64_t MinSparseIds = 65536;
+
+      //! Number of the ids per document a larger table may cover
+      static const uint64_t MaxIdsPerDocument = 8;
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      DocumentTable()
+      {
+        clear();
+      }
+
+      //------------------------------------------------------------------------
+      //! Add a document, the id needs to be positive and larger than the
+      //! ones already there
+      //!
+      //! @return false if the id is too small or the name is empty
+      //------------------------------------------------------------------------
+      bool add( docid_t id, std::string_view name );
+
+      //------------------------------------------------------------------------
+      //! Move in the documents of another table, all its ids need to be
+      //! larger than the ones of this table
+      //!
+      //! @return false if the ids overlap
+      //------------------------------------------------------------------------
+      bool append( DocumentTable &other );
+
+      //------------------------------------------------------------------------
+      //! Copy in a table stored in the document sections of an index file
+      //!
+      //! @param firstId the id of the first document
+      //! @param offsets numIds+1 ascending offsets of the names in the blob
+      //! @param numIds  number of the ids covered
+      //! @param names   the names
+      //! @param length  length of the names
+      //! @return        false if the offsets are not ascending or point
+      //!                past the names, the table is empty then
+      //------------------------------------------------------------------------
+      bool assign( docid_t         firstId,
+                   const uint64_t *offsets,
+                   uint64_t        numIds,
+                   const char     *names,
+                   uint64_t        length );
+
+      //------------------------------------------------------------------------
+      //! Remove all the documents
+      //------------------------------------------------------------------------
+      void clear();
+
+      //------------------------------------------------------------------------
+      //! Get the name of a document, empty if the id is not in use
+      //------------------------------------------------------------------------
+      std::string_view get( docid_t id ) const
+      {
+        if( id < pFirstId || id - pFirstId >= pOffsets.size()-1 )
+          return std::string_view();
+        const uint64_t *offset = &pOffsets[id-pFirstId];
+        return std::string_view( pNames.data() + offset[0],
+                                 offset[1] - offset[0] );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the first document with an id larger than the given one
+      //!
+      //! @return 0 if there is none
+      //------------------------------------------------------------------------
+      docid_t next( docid_t id ) const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents in the bitmap
+      //------------------------------------------------------------------------
+      void fill( Bitmap &bitmap ) const
+      {
+        fill( bitmap, pFirstId, pOffsets.data(), pOffsets.size()-1, pCount );
+      }
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents of a table stored elsewhere, as
+      //! in an index file; the ranges of the ids in use are set at once
+      //!
+      //! @param firstId      the id of the first document
+      //! @param offsets      numIds+1 offsets of the names
+      //! @param numIds       number of the ids covered
+      //! @param numDocuments number of the ids in use
+      //------------------------------------------------------------------------
+      static void fill( Bitmap         &bitmap,
+                        docid_t         firstId,
+                        const uint64_t *offsets,
+                        uint64_t        numIds,
+                        uint64_t        numDocuments );
+
+      //------------------------------------------------------------------------
+      //! Check whether a table of the given number of documents is dense
+      //! enough to cover the given number of ids
+      //------------------------------------------------------------------------
+      static bool isDenseEnough( uint64_t numIds, uint64_t numDocuments )
+      {
+        return numIds <= MinSparseIds ||
+          (numIds-1) / MaxIdsPerDocument < numDocuments;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of the documents
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pCount;
+      }
+
+      //------------------------------------------------------------------------
+      //! The first id the table covers, 0 if it is empty
+      //------------------------------------------------------------------------
+      docid_t firstId() const
+      {
+        return pFirstId;
+      }
+
+      //------------------------------------------------------------------------
+      //! The id following the last one the table covers
+      //------------------------------------------------------------------------
+      docid_t endId() const
+      {
+        return pFirstId + pOffsets.size()-1;
+      }
+
+      //------------------------------------------------------------------------
+      //! The offsets of the names, one per id plus the end of the blob
+      //------------------------------------------------------------------------
+      const std::vector<uint64_t> &getOffsets() const
+      {
+        return pOffsets;
+      }
+
+      //------------------------------------------------------------------------
+      //! All the names back to back
+      //------------------------------------------------------------------------
+      const std::string &getNames() const
+      {
+        return pNames;
+      }
+
+    private:
+      void extend( docid_t id );
+
+      docid_t               pFirstId = 0;
+      uint64_t              pCount   = 0;
+      std::vector<uint64_t> pOffsets;
+      std::string           pNames;
+  };
+}
@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <Librarian/FilterCache.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Record an execution of a sub-tree; the hashes of the recent records
+  // are kept in a ring, so a collision may at worst admit a sub-tree early
+  // or pass over one
+  //----------------------------------------------------------------------------
+  bool FilterCache::record( const std::string &key, uint64_t version )
+  {
+    validate( version );
+    size_t hash = std::hash<std::string>()( key );
+    if( pPassed.count( hash ) )
+      return false;
+
+    if( pHistory.size() < HistorySize )
+      pHistory.push_back( hash );
+    else
+    {
+      size_t &old = pHistory[pHistoryPos];
+      auto    it  = pSeen.find( old );
+      if( --it->second == 0 )
+        pSeen.erase( it );
+      old          = hash;
+      pHistoryPos  = (pHistoryPos+1) % HistorySize;
+    }
+    return ++pSeen[hash] >= pAdmission;
+  }
+
+  //----------------------------------------------------------------------------
+  // Pass over a cheap sub-tree; the set is bounded by the history size
+  // and started over when full, a sub-tree dropped from it is at worst
+  // admitted and passed over once more
+  //----------------------------------------------------------------------------
+  void FilterCache::passOver( const std::string &key, uint64_t version )
+  {
+    validate( version );
+    if( pPassed.size() == HistorySize )
+      pPassed.clear();
+    pPassed.insert( std::hash<std::string>()( key ) );
+  }
+
+  //----------------------------------------------------------------------------
+  // The sub-trees passed over may cost more in a new version of the index
+  //----------------------------------------------------------------------------
+  void FilterCache::validate( uint64_t version )
+  {
+    if( version == pVersion )
+      return;
+    pPassed.clear();
+    pVersion = version;
+  }
+}
@@ -0,0 +1,160 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Librarian/Bitmap.hh>
+#include <Librarian/LRUCache.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Documents matching the sub-trees that the recent queries share, keyed
+  //! by the canonical text of the sub-tree
+  //!
+  //! A sub-tree is admitted only once it has been recorded a number of
+  //! times within the last HistorySize records, so that the clauses seen
+  //! once do not take the space of the ones that repeat. An admitted
+  //! sub-tree cheap enough to run as it is gets passed over until the
+  //! index changes, so that it does not stand in the way of the costlier
+  //! ones of the same query. The documents are
+  //! kept as bitmaps covering the index, shared with the queries using
+  //! them, so that an entry evicted while a query runs stays alive until
+  //! it is done. The entries live in a plain LRUCache.
+  //----------------------------------------------------------------------------
+  class FilterCache
+  {
+    public:
+      //! Number of the recent records the sub-trees are counted in
+      static const size_t HistorySize = 256;
+
+      //! Default number of records admitting a sub-tree
+      static const uint32_t DefaultAdmission = 2;
+
+      typedef std::shared_ptr<const Bitmap> Docs;
+
+      //------------------------------------------------------------------------
+      //! Counters of the cache
+      //------------------------------------------------------------------------
+      struct Statistics: public LRUCache<Docs>::Statistics
+      {
+        uint64_t admissions = 0; //!< sub-trees materialized for insertion
+      };
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param budget    maximal number of bytes the entries may take
+      //! @param admission number of records within the history admitting
+      //!                  a sub-tree
+      //------------------------------------------------------------------------
+      FilterCache( size_t budget, uint32_t admission = DefaultAdmission ):
+        pEntries( budget ), pAdmission( admission ) {}
+
+      //------------------------------------------------------------------------
+      //! Find the documents matching a sub-tree
+      //!
+      //! @param key     canonical text of the sub-tree
+      //! @param version version of the index the documents need to match
+      //! @return        the documents or null if the sub-tree is not cached
+      //------------------------------------------------------------------------
+      Docs find( const std::string &key, uint64_t version )
+      {
+        const Docs *docs = pEntries.find( key, version );
+        return docs ? *docs : nullptr;
+      }
+
+      //------------------------------------------------------------------------
+      //! Record an execution of a sub-tree, unless it has been passed over
+      //!
+      //! @param key     canonical text of the sub-tree
+      //! @param version version of the index the sub-tree runs against
+      //! @return        true if the sub-tree has been run often enough for
+      //!                its documents to be inserted
+      //------------------------------------------------------------------------
+      bool record( const std::string &key, uint64_t version );
+
+      //------------------------------------------------------------------------
+      //! Pass over an admitted sub-tree that is cheap enough to run as it
+      //! is, it is not recorded again until the version of the index changes
+      //------------------------------------------------------------------------
+      void passOver( const std::string &key, uint64_t version );
+
+      //------------------------------------------------------------------------
+      //! Store the documents of an admitted sub-tree, see LRUCache::insert
+      //!
+      //! @param key     canonical text of the sub-tree
+      //! @param docs    the documents
+      //! @param version version of the index the documents come from
+      //------------------------------------------------------------------------
+      void insert( const std::string &key, Docs docs, uint64_t version )
+      {
+        size_t size = docs->memoryUsage() + sizeof(Bitmap);
+        ++pAdmissions;
+        pEntries.insert( key, std::move( docs ), size, version );
+      }
+
+      //------------------------------------------------------------------------
+      //! Drop all the entries, the history is kept
+      //------------------------------------------------------------------------
+      void clear()
+      {
+        pEntries.clear();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the counters
+      //------------------------------------------------------------------------
+      Statistics getStatistics() const
+      {
+        Statistics stats;
+        static_cast<LRUCache<Docs>::Statistics&>( stats ) =
+          pEntries.getStatistics();
+        stats.admissions = pAdmissions;
+        return stats;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the maximal number of bytes the entries may take
+      //------------------------------------------------------------------------
+      size_t getBudget() const
+      {
+        return pEntries.getBudget();
+      }
+
+    private:
+      void validate( uint64_t version );
+
+      LRUCache<Docs>                        pEntries;
+      uint32_t                              pAdmission;
+      uint64_t                              pAdmissions = 0;
+      std::vector<size_t>                   pHistory;
+      size_t                                pHistoryPos = 0;
+      std::unordered_map<size_t, uint32_t>  pSeen;
+      std::unordered_set<size_t>            pPassed;
+      uint64_t                              pVersion = 0;
+  };
+}
@@ -18,29 +18,239 @@
 //------------------------------------------------------------------------------
 
 #include <fstream>
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
 #include <Librarian/Index.hh>
+#include <Librarian/IndexFile.hh>
+#include <Librarian/LevenshteinAutomaton.hh>
+
+namespace
+{
+  using namespace Librarian;
+
+  //----------------------------------------------------------------------------
+  // Visit the selected terms of a dictionary in order
+  //----------------------------------------------------------------------------
+  void visitSorted( std::vector<Index::Dict::const_iterator> &terms,
+                    const IndexReader::TermVisitor           &visitor )
+  {
+    std::sort( terms.begin(), terms.end(),
+               []( auto &a, auto &b ) { return a->first < b->first; } );
+
+    for( auto &it: terms )
+      if( !visitor( it->first,
+                    TermPostings( it->second.getPostings().view() ) ) )
+        return;
+  }
+}
 
 namespace Librarian
 {
   //----------------------------------------------------------------------------
-  // Dump the index to a file
+  // Dump the index to a binary index file
   //----------------------------------------------------------------------------
   Status Index::dump( const std::string &filename ) const
+  {
+    IndexFileWriter writer;
+    Status st = writer.open( filename );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // The dictionary is sorted so that terms can be looked up in place
+    //--------------------------------------------------------------------------
+    std::vector<const Dict::value_type *> terms;
+    terms.reserve( pIndex.size() );
+    for( auto &term: pIndex )
+      terms.push_back( &term );
+    std::sort( terms.begin(), terms.end(),
+               []( const Dict::value_type *a, const Dict::value_type *b )
+                 { return a->first < b->first; } );
+
+    //--------------------------------------------------------------------------
+    // Dump the postings, the blocks go as they are and the tails get
+    // encoded on the way
+    //--------------------------------------------------------------------------
+    TermDictionaryWriter dictionary;
+    writer.beginSection( IndexFile::PostingsSection );
+    for( auto term: terms )
+    {
+      IndexFile::TermEntry entry;
+      writer.appendPostings( term->second.getPostings(), entry );
+      dictionary.add( term->first, entry );
+    }
+    writer.endSection();
+
+    //--------------------------------------------------------------------------
+    // Dump the dictionary
+    //--------------------------------------------------------------------------
+    writer.appendDictionary( dictionary );
+
+    //--------------------------------------------------------------------------
+    // Dump the document table as it is, it starts at the first registered
+    // document so that the segments of an index only cover their own
+    // documents; the ids past the last one up to the free one get empty
+    // names
+    //--------------------------------------------------------------------------
+    docid_t firstId = pDocuments.firstId() ? pDocuments.firstId() : pFreeDocId;
+    docid_t endId   = pDocuments.firstId() ? pDocuments.endId()   : pFreeDocId;
+    std::vector<uint64_t> tail( pFreeDocId - endId,
+                                pDocuments.getNames().size() );
+
+    writer.beginSection( IndexFile::DocOffsetsSection );
+    writer.append( pDocuments.getOffsets().data(),
+                   pDocuments.getOffsets().size()*sizeof(uint64_t) );
+    writer.append( tail.data(), tail.size()*sizeof(uint64_t) );
+    writer.endSection();
+
+    writer.beginSection( IndexFile::DocNamesSection );
+    writer.append( pDocuments.getNames().data(),
+                   pDocuments.getNames().size() );
+    writer.endSection();
+
+    return writer.commit( terms.size(), pDocuments.size(), firstId,
+                          pFreeDocId );
+  }
+
+  //----------------------------------------------------------------------------
+  // Load an index from a binary index file
+  //----------------------------------------------------------------------------
+  Status Index::load( const std::string &filename )
+  {
+    //--------------------------------------------------------------------------
+    // Read the file
+    //--------------------------------------------------------------------------
+    std::ifstream in( filename.c_str(), std::ios::binary );
+    if( !in.is_open() )
+      return Status( Status::errIO, strerror(errno ) );
+
+    in.seekg( 0, std::ios::end );
+    uint64_t size = in.tellg();
+    in.seekg( 0, std::ios::beg );
+    std::vector<uint64_t> buffer( (size+7)/8 );
+    in.read( (char *)buffer.data(), size );
+    if( !in.good() )
+      return Status( Status::errIO, strerror(errno ) );
+
+    IndexFile file;
+    Status st = file.open( buffer.data(), size );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // Take the postings as they are
+    //--------------------------------------------------------------------------
+    cleanUp();
+    pIndex.reserve( file.numTerms() );
+    for( auto it = file.getDictionary().begin(); it.valid(); it.next() )
+    {
+      const IndexFile::TermEntry &entry = it.entry();
+      TermData &d = pIndex[std::string( it.term() )];
+      if( !d.assignPostings( file.getBlockHeaders( entry ), entry.numBlocks,
+                             file.getBlockData( entry ), entry.dataLength ) ||
+          d.numPostings() != entry.numPostings )
+      {
+        cleanUp();
+        return Status( Status::errIO, "Index file corrupted: bad postings" );
+      }
+    }
+
+    //--------------------------------------------------------------------------
+    // Read the document table
+    //--------------------------------------------------------------------------
+    const IndexFile::Header &header = file.getHeader();
+    if( !pDocuments.assign( header.firstDocId, file.getDocumentOffsets(),
+                            header.freeDocId - header.firstDocId,
+                            file.getDocumentNames(),
+                            file.getDocumentNamesLength() ) )
+    {
+      cleanUp();
+      return Status( Status::errIO, "Index file corrupted: bad documents" );
+    }
+    pFreeDocId = std::max( header.freeDocId, (uint64_t)1 );
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms starting with the prefix
+  //----------------------------------------------------------------------------
+  void Index::visitTerms( std::string_view   prefix,
+                          const TermVisitor &visitor ) const
+  {
+    std::vector<Dict::const_iterator> terms;
+    for( auto it = pIndex.begin(); it != pIndex.end(); ++it )
+      if( std::string_view( it->first ).starts_with( prefix ) )
+        terms.push_back( it );
+    visitSorted( terms, visitor );
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms within the edit distance from the term
+  //----------------------------------------------------------------------------
+  void Index::visitSimilarTerms( std::string_view   term,
+                                 uint32_t           maxDistance,
+                                 const TermVisitor &visitor ) const
+  {
+    LevenshteinAutomaton automaton( term, maxDistance );
+    std::vector<Dict::const_iterator> terms;
+    for( auto it = pIndex.begin(); it != pIndex.end(); ++it )
+      if( automaton.isMatch( automaton.run( automaton.start(), it->first ) ) )
+        terms.push_back( it );
+    visitSorted( terms, visitor );
+  }
+
+  //----------------------------------------------------------------------------
+  // Move in the contents of another index
+  //----------------------------------------------------------------------------
+  void Index::merge( Index &other )
+  {
+    mergeTerms( other.pIndex );
+    pDocuments.append( other.pDocuments );
+    pFreeDocId = std::max( pFreeDocId, other.pFreeDocId );
+    other.cleanUp();
+  }
+
+  //----------------------------------------------------------------------------
+  // Move in the terms of a dictionary
+  //----------------------------------------------------------------------------
+  void Index::mergeTerms( Dict &terms )
+  {
+    for( auto &term: terms )
+    {
+      auto it = pIndex.find( term.first );
+      if( it == pIndex.end() )
+      {
+        pIndex.emplace( term.first, std::move( term.second ) );
+        continue;
+      }
+
+      PostingReader reader( term.second.getPostings().view() );
+      docid_t id;
+      while( reader.next( id ) )
+        it->second.addPosting( id );
+    }
+    terms.clear();
+    ++pVersion;
+  }
+
+  //----------------------------------------------------------------------------
+  // Export the index to a text file
+  //----------------------------------------------------------------------------
+  Status Index::exportText( const std::string &filename ) const
   {
     std::ofstream out( filename.c_str() );
     if( !out.is_open() )
       return Status( Status::errIO, strerror(errno ) );
 
     //--------------------------------------------------------------------------
-    // Dump document ids, all but the dummy one
+    // Dump document ids, all but the dummy one; the name takes the rest
+    // of the line
     //--------------------------------------------------------------------------
-    out << pDocuments.size()-1 << std::endl;
-    for( auto it = pDocuments.begin(); it != pDocuments.end(); ++it )
-      if( it->first != 0 )
-        out << it->first << " " << it->second << std::endl;
+    out << pDocuments.size() << std::endl;
+    for( docid_t id = pDocuments.next( 0 ); id; id = pDocuments.next( id ) )
+      out << id << " " << pDocuments.get( id ) << std::endl;
 
     //--------------------------------------------------------------------------
     // Dump the postings
@@ -49,18 +259,19 @@ namespace Librarian
     for( auto it = pIndex.begin(); it != pIndex.end(); ++it )
     {
       out << it->first << " " << it->second.numPostings() << " ";
-      auto postIt = it->second.postingsBegin();
-      for( ; postIt != it->second.postingsEnd(); ++postIt )
-        out << *postIt << " ";
+      PostingReader reader( it->second.getPostings().view() );
+      docid_t id;
+      while( reader.next( id ) )
+        out << id << " ";
       out << std::endl;
     }
     return Status();
   }
 
   //----------------------------------------------------------------------------
-  // Load an index from a file
+  // Import an index from a text file
   //----------------------------------------------------------------------------
-  Status Index::load( const std::string &filename )
+  Status Index::importText( const std::string &filename )
   {
     //--------------------------------------------------------------------------
     // Open the file
@@ -72,6 +283,7 @@ namespace Librarian
     //--------------------------------------------------------------------------
     // Read the document index
     //--------------------------------------------------------------------------
+    cleanUp();
     pFreeDocId = 0;
     size_t numDocs;
     in >> numDocs;
@@ -83,19 +295,41 @@ namespace Librarian
 
     docid_t id;
     std::string doc;
-    for( int i = 0; i < numDocs; ++i )
+    std::vector<std::pair<docid_t, std::string>> docs;
+    for( size_t i = 0; i < numDocs; ++i )
     {
-      in >> id >> doc;
-      if( !in.good() )
+      in >> id;
+      std::getline( in, doc );
+      if( !in.good() || !id || doc.size() < 2 || doc[0] != ' ' )
       {
         cleanUp();
         return Status( Status::errIO, "File corrupted" );
       }
-      pDocuments[id] = doc;
+      docs.emplace_back( id, doc.substr( 1 ) );
       pFreeDocId = std::max( pFreeDocId, id );
     }
     ++pFreeDocId;
 
+    //--------------------------------------------------------------------------
+    // The table is filled in id order, the last name of a duplicate id wins;
+    // every id of the range takes an offset, so the range needs to be dense
+    //--------------------------------------------------------------------------
+    std::stable_sort( docs.begin(), docs.end(),
+                      []( auto &a, auto &b ) { return a.first < b.first; } );
+    size_t distinct = 0;
+    for( size_t i = 0; i < docs.size(); ++i )
+      distinct += i+1 == docs.size() || docs[i+1].first != docs[i].first;
+    if( distinct && !DocumentTable::isDenseEnough(
+                      pFreeDocId - docs.front().first, distinct ) )
+    {
+      cleanUp();
+      return Status( Status::errLimit, "Document ids too sparse" );
+    }
+
+    for( size_t i = 0; i < docs.size(); ++i )
+      if( i+1 == docs.size() || docs[i+1].first != docs[i].first )
+        pDocuments.add( docs[i].first, docs[i].second );
+
     //--------------------------------------------------------------------------
     // Read back the postings
     //--------------------------------------------------------------------------
@@ -109,7 +343,7 @@ namespace Librarian
 
     std::string term;
     size_t numPostings;
-    for( int i = 0; i < numTerms; ++i )
+    for( size_t i = 0; i < numTerms; ++i )
     {
       in >> term >> numPostings;
       if( !in.good() )
@@ -119,7 +353,7 @@ namespace Librarian
       }
 
       TermData &d = pIndex[term];
-      for( int k = 0; k < numPostings; ++k )
+      for( size_t k = 0; k < numPostings; ++k )
       {
         in >> id;
         if( !in.good() )
@@ -129,6 +363,7 @@ namespace Librarian
         }
         d.addPosting( id );
       }
+      d.seal();
     }
     return Status();
   }
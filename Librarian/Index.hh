@@ -20,16 +20,31 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
+#include <functional>
 #include <unordered_map>
 #include <string>
-#include <list>
+#include <string_view>
 
 #include <Librarian/Status.hh>
+#include <Librarian/Postings.hh>
+#include <Librarian/IndexReader.hh>
+#include <Librarian/DocumentTable.hh>
 
 namespace Librarian
 {
-  typedef uint64_t docid_t;
+  //----------------------------------------------------------------------------
+  //! Hash of strings that lets string keyed hash maps be searched with
+  //! string views, without making a string out of them
+  //----------------------------------------------------------------------------
+  struct StringHash
+  {
+    typedef void is_transparent;
+
+    size_t operator()( std::string_view str ) const
+    {
+      return std::hash<std::string_view>()( str );
+    }
+  };
 
   //----------------------------------------------------------------------------
   //! Term data representation
@@ -37,105 +52,97 @@ namespace Librarian
   class TermData
   {
     public:
-      typedef std::list<docid_t> Postings;
+      typedef PostingList Postings;
 
       //------------------------------------------------------------------------
       //! Number of postings
       //------------------------------------------------------------------------
       uint64_t numPostings() const
       {
-        return pCount;
+        return pPostings.size();
       }
 
       //------------------------------------------------------------------------
-      //! Beginning iterator
+      //! Get postings
       //------------------------------------------------------------------------
-      Postings::const_iterator postingsBegin() const
+      const Postings &getPostings() const
       {
-        return pPostings.begin();
+        return pPostings;
       }
 
       //------------------------------------------------------------------------
-      //! End iterator
+      //! Add posting
       //------------------------------------------------------------------------
-      Postings::const_iterator postingsEnd() const
+      void addPosting( docid_t id )
       {
-        return pPostings.end();
+        pPostings.add( id );
       }
 
       //------------------------------------------------------------------------
-      //! Get postings
+      //! Remove posting
       //------------------------------------------------------------------------
-      const Postings &getPostings() const
+      void removePosting( docid_t id )
       {
-        return pPostings;
+        pPostings.remove( id );
       }
 
       //------------------------------------------------------------------------
-      //! Add posting
+      //! Pick the final containers for the postings
       //------------------------------------------------------------------------
-      void addPosting( docid_t id )
+      void seal()
       {
-        if( pPostings.empty() || pPostings.back() < id )
-        {
-          pPostings.push_back(id);
-          ++pCount;
-          return;
-        }
-
-        auto it = pPostings.begin();
-        for( ; it != pPostings.end() && (*it) < id; ++it );
-        if( *it == id )
-          return;
-        pPostings.push_back(id);
-        ++pCount;
+        pPostings.seal();
       }
 
       //------------------------------------------------------------------------
-      //! Remove posting
+      //! Replace the postings with already encoded blocks
       //------------------------------------------------------------------------
-      void removePosting( docid_t id )
+      bool assignPostings( const PostingList::BlockHeader *headers,
+                           size_t                          numBlocks,
+                           const uint8_t                  *data,
+                           size_t                          length )
       {
-        auto it = pPostings.begin();
-        for( ; it != pPostings.end() && *it != id; ++it );
-        if( it == pPostings.end() )
-          return;
-        pPostings.erase(it);
-        --pCount;
+        return pPostings.assign( headers, numBlocks, data, length );
       }
 
     private:
-      uint64_t           pCount;
-      std::list<docid_t> pPostings;
+      PostingList pPostings;
   };
 
   //----------------------------------------------------------------------------
   //! Represenation of the search index
   //----------------------------------------------------------------------------
-  class Index
+  class Index: public IndexReader
   {
     public:
-      typedef std::unordered_map<std::string, TermData> Dict;
-      typedef std::map<docid_t, std::string>            DocMap;
+      typedef std::unordered_map<std::string, TermData,
+                                 StringHash, std::equal_to<>> Dict;
 
       //------------------------------------------------------------------------
       //! Constructor
       //------------------------------------------------------------------------
-      Index()
-      {
-        pDocuments[0] = "";
-      }
+      Index() {}
 
       //------------------------------------------------------------------------
-      //! Dump the index to a file
+      //! Dump the index to a binary index file
       //------------------------------------------------------------------------
       Status dump( const std::string &filename ) const;
 
       //------------------------------------------------------------------------
-      //! Load an index from a file
+      //! Load an index from a binary index file
       //------------------------------------------------------------------------
       Status load( const std::string &filename );
 
+      //------------------------------------------------------------------------
+      //! Export the index to a text file
+      //------------------------------------------------------------------------
+      Status exportText( const std::string &filename ) const;
+
+      //------------------------------------------------------------------------
+      //! Import an index from a text file
+      //------------------------------------------------------------------------
+      Status importText( const std::string &filename );
+
       //------------------------------------------------------------------------
       //! Add posting
       //------------------------------------------------------------------------
@@ -146,58 +153,136 @@ namespace Librarian
           pIndex[term].addPosting( posting );
         else
           it->second.addPosting( posting );
+        ++pVersion;
+      }
+
+      //------------------------------------------------------------------------
+      //! Find the postings of a term
+      //------------------------------------------------------------------------
+      virtual bool findTerm( std::string_view  term,
+                             TermPostings     &postings ) const
+      {
+        auto it = pIndex.find( term );
+        if( it == pIndex.end() )
+          return false;
+        postings = TermPostings( it->second.getPostings().view() );
+        return true;
+      }
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms starting with the prefix, the dictionary is
+      //! not ordered so the matching terms are sorted first
+      //------------------------------------------------------------------------
+      virtual void visitTerms( std::string_view   prefix,
+                               const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms within the edit distance from the term, all
+      //! the terms are run through the automaton, then sorted
+      //------------------------------------------------------------------------
+      virtual void visitSimilarTerms( std::string_view   term,
+                                      uint32_t           maxDistance,
+                                      const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Move in the contents of another index, all its documents need to
+      //! have larger ids than the ones of this index
+      //------------------------------------------------------------------------
+      void merge( Index &other );
+
+      //------------------------------------------------------------------------
+      //! Move in the terms of a dictionary, their postings need to have
+      //! larger ids than the ones of this index
+      //------------------------------------------------------------------------
+      void mergeTerms( Dict &terms );
+
+      //------------------------------------------------------------------------
+      //! Pick the final containers for all the postings
+      //------------------------------------------------------------------------
+      void seal()
+      {
+        for( auto &term: pIndex )
+          term.second.seal();
       }
 
       //------------------------------------------------------------------------
       //! Get document name for the given id
       //------------------------------------------------------------------------
-      const std::string &getDocumentName( docid_t id ) const
+      virtual std::string_view getDocumentName( docid_t id ) const
       {
-        auto it = pDocuments.find( id );
-        if( it == pDocuments.end() )
-          return pDocuments.find(0)->second;
-        return it->second;
+        return pDocuments.get( id );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the first document with an id larger than the given one
+      //------------------------------------------------------------------------
+      virtual docid_t nextDocument( docid_t id ) const
+      {
+        return pDocuments.next( id );
+      }
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents in use
+      //------------------------------------------------------------------------
+      virtual void fillDocuments( Bitmap &bitmap ) const
+      {
+        pDocuments.fill( bitmap );
       }
 
       //------------------------------------------------------------------------
       //! Register new document in the index
+      //!
+      //! @return the id of the document, 0 if the name is empty and the
+      //!         document was not registered
       //------------------------------------------------------------------------
-      docid_t registerDocument( const std::string &name )
+      docid_t registerDocument( std::string_view name )
       {
-        pDocuments[pFreeDocId] = name;
+        if( !pDocuments.add( pFreeDocId, name ) )
+          return 0;
+        ++pVersion;
         return pFreeDocId++;
       }
 
+      //------------------------------------------------------------------------
+      //! Set the id the next registered document gets, it has to be larger
+      //! than the ones in use
+      //------------------------------------------------------------------------
+      void setNextDocId( docid_t id )
+      {
+        pFreeDocId = id;
+        ++pVersion;
+      }
+
       //------------------------------------------------------------------------
       //! Get number of documents
       //------------------------------------------------------------------------
-      docid_t numDocuments() const
+      virtual docid_t numDocuments() const
       {
         return pDocuments.size();
       }
 
       //------------------------------------------------------------------------
-      //! Return the document map
+      //! Get the largest document id in use
       //------------------------------------------------------------------------
-      const DocMap &getDocuments() const
+      virtual docid_t maxDocId() const
       {
-        return pDocuments;
+        return pFreeDocId-1;
       }
 
       //------------------------------------------------------------------------
-      //! Begin documents
+      //! Get the version of the contents, it changes with every modification
       //------------------------------------------------------------------------
-      DocMap::const_iterator documentsBegin() const
+      virtual uint64_t getVersion() const
       {
-        return pDocuments.begin();
+        return pVersion;
       }
 
       //------------------------------------------------------------------------
-      //!
+      //! Return the document table
       //------------------------------------------------------------------------
-      DocMap::const_iterator documentsEnd() const
+      const DocumentTable &getDocuments() const
       {
-        return pDocuments.end();
+        return pDocuments;
       }
 
       //------------------------------------------------------------------------
@@ -219,7 +304,7 @@ namespace Librarian
       //------------------------------------------------------------------------
       //! Find term
       //------------------------------------------------------------------------
-      Dict::const_iterator find( const std::string &term ) const
+      Dict::const_iterator find( std::string_view term ) const
       {
         return pIndex.find( term );
       }
@@ -229,11 +314,12 @@ namespace Librarian
       {
         pIndex.clear();
         pDocuments.clear();
-        pDocuments[0] = "";
-        pFreeDocId    = 1;
+        pFreeDocId = 1;
+        ++pVersion;
       }
-      docid_t pFreeDocId = 1;
-      Dict    pIndex;
-      DocMap  pDocuments;
+      docid_t       pFreeDocId = 1;
+      uint64_t      pVersion   = 0;
+      Dict          pIndex;
+      DocumentTable pDocuments;
   };
 }
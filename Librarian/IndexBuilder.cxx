@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <Librarian/IndexBuilder.hh>
+#include <Librarian/Tokenizer.hh>
+#include <Librarian/Normalizer.hh>
+
+namespace
+{
+  using namespace Librarian;
+
+  //----------------------------------------------------------------------------
+  // Number of consecutive files a worker takes at a time and the number of
+  // parts the terms are split into for merging
+  //----------------------------------------------------------------------------
+  const size_t BatchSize = 64;
+  const size_t NumShards = 256;
+
+  //----------------------------------------------------------------------------
+  // Partial inverted index of a batch of files. The terms are interned, so a
+  // term seen before in the batch is found by a lookup that allocates
+  // nothing, and the postings are (term id, position) pairs split by shard,
+  // in the order of the documents; the position counts only the files of
+  // the batch that could be read
+  //----------------------------------------------------------------------------
+  typedef std::unordered_map<std::string, uint32_t,
+                             StringHash, std::equal_to<>> TermIds;
+  typedef std::vector<std::pair<uint32_t, uint32_t>>     PartialShard;
+
+  struct Partial
+  {
+    //--------------------------------------------------------------------------
+    // Get the id of a term, assign a new one if the term is new
+    //--------------------------------------------------------------------------
+    uint32_t intern( std::string_view term )
+    {
+      auto it = ids.find( term );
+      if( it != ids.end() )
+        return it->second;
+      it = ids.emplace( std::string( term ), terms.size() ).first;
+      terms.push_back( &it->first );
+      termShards.push_back( StringHash()( term ) % NumShards );
+      return it->second;
+    }
+
+    TermIds                          ids;
+    std::vector<const std::string *> terms;
+    std::vector<uint32_t>            termShards;
+    std::vector<PartialShard>        shards;
+    uint32_t                         numDocs = 0;
+    docid_t                          firstId = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  // Call the function for all the numbers in [0, num) using the given
+  // number of threads, the calling one included
+  //----------------------------------------------------------------------------
+  template<typename Func>
+  void parallelFor( unsigned numThreads, size_t num, Func func )
+  {
+    std::atomic<size_t> next( 0 );
+    auto work = [&]()
+    {
+      for( size_t i; (i = next++) < num; )
+        func( i );
+    };
+
+    std::vector<std::thread> threads;
+    for( size_t i = 1; i < std::min<size_t>( numThreads, num ); ++i )
+      threads.emplace_back( work );
+    work();
+    for( auto &t: threads )
+      t.join();
+  }
+
+  //----------------------------------------------------------------------------
+  // Tokenize a file into a sorted list of unique term ids
+  //----------------------------------------------------------------------------
+  Status tokenize( const std::string     &path,
+                   Normalizer            &norm,
+                   std::string           &buffer,
+                   Partial               &partial,
+                   std::vector<uint32_t> &terms,
+                   uint64_t              &count )
+  {
+    MappedTokenizer t;
+    Status st = t.open( path );
+    if( !st.isOK() )
+    {
+      t.close();
+      return st;
+    }
+
+    terms.clear();
+    while( t.loadNextToken() )
+    {
+      std::string_view token = norm.normalize( t.getToken(), buffer );
+      if( !token.empty() )
+        terms.push_back( partial.intern( token ) );
+    }
+    t.close();
+
+    count = terms.size();
+    std::sort( terms.begin(), terms.end() );
+    terms.erase( std::unique( terms.begin(), terms.end() ), terms.end() );
+    return Status();
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Constructor
+  //----------------------------------------------------------------------------
+  IndexBuilder::IndexBuilder( unsigned numThreads ): pNumThreads( numThreads )
+  {
+    if( !pNumThreads )
+      pNumThreads = std::max( std::thread::hardware_concurrency(), 1u );
+  }
+
+  //----------------------------------------------------------------------------
+  // Build an index out of the files
+  //----------------------------------------------------------------------------
+  void IndexBuilder::build( Index                          &index,
+                            const std::vector<std::string> &paths,
+                            std::vector<Document>          &documents )
+  {
+    documents.assign( paths.size(), Document() );
+    size_t               numBatches = (paths.size()+BatchSize-1)/BatchSize;
+    std::vector<Partial> partials( numBatches );
+    std::mutex           callbackMutex;
+
+    //--------------------------------------------------------------------------
+    // Tokenize the batches into partial indices
+    //--------------------------------------------------------------------------
+    parallelFor( pNumThreads, numBatches, [&]( size_t batch )
+    {
+      EnglishNormalizer      norm;
+      std::string            buffer;
+      std::vector<uint32_t>  terms;
+      Partial               &partial = partials[batch];
+      size_t                 last    = std::min( paths.size(),
+                                                 (batch+1)*BatchSize );
+      partial.shards.resize( NumShards );
+
+      for( size_t i = batch*BatchSize; i < last; ++i )
+      {
+        Document &doc = documents[i];
+        doc.status = tokenize( paths[i], norm, buffer, partial, terms,
+                               doc.tokens );
+        if( doc.status.isOK() )
+        {
+          doc.terms = terms.size();
+          uint32_t pos = partial.numDocs++;
+          for( auto term: terms )
+            partial.shards[partial.termShards[term]].emplace_back( term, pos );
+        }
+
+        if( pCallback )
+        {
+          std::lock_guard<std::mutex> lock( callbackMutex );
+          pCallback( paths[i], doc );
+        }
+      }
+    } );
+
+    //--------------------------------------------------------------------------
+    // Assign the ids in the order of the input
+    //--------------------------------------------------------------------------
+    size_t batch = 0;
+    for( size_t i = 0; i < paths.size(); ++i )
+    {
+      if( i % BatchSize == 0 )
+        partials[batch++].firstId = index.maxDocId()+1;
+      if( !documents[i].status.isOK() )
+        continue;
+      //------------------------------------------------------------------------
+      // The postings count on every tokenized document getting the next id,
+      // so a path with no file name past the last slash is used whole
+      //------------------------------------------------------------------------
+      size_t slash = paths[i].find_last_of( '/' );
+      documents[i].id = index.registerDocument(
+        slash == std::string::npos || slash+1 == paths[i].size() ?
+        paths[i] : paths[i].substr( slash+1 ) );
+    }
+
+    //--------------------------------------------------------------------------
+    // Merge and seal the shards; the batches come in the order of the ids
+    // so the postings only need to be appended
+    //--------------------------------------------------------------------------
+    std::vector<Index::Dict> shards( NumShards );
+    parallelFor( pNumThreads, NumShards, [&]( size_t shard )
+    {
+      Index::Dict &dict = shards[shard];
+      for( auto &partial: partials )
+      {
+        for( auto &posting: partial.shards[shard] )
+          dict[*partial.terms[posting.first]].addPosting( partial.firstId +
+                                                          posting.second );
+        PartialShard().swap( partial.shards[shard] );
+      }
+      for( auto &term: dict )
+        term.second.seal();
+    } );
+
+    for( auto &dict: shards )
+      index.mergeTerms( dict );
+  }
+}
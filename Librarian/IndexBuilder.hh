@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Librarian/Status.hh>
+#include <Librarian/Index.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Build an index out of files using a pool of worker threads
+  //!
+  //! The workers tokenize and normalize runs of consecutive files into
+  //! partial inverted indices of their own; the document ids follow the
+  //! order of the input, so the postings of the partial indices only need to
+  //! be concatenated. The terms are then split into shards that are merged
+  //! and sealed in parallel as well. The result does not depend on the
+  //! number of threads, a single thread produces the same index as many.
+  //----------------------------------------------------------------------------
+  class IndexBuilder
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Outcome of indexing a file
+      //------------------------------------------------------------------------
+      struct Document
+      {
+        Status   status;        //!< errors opening the file
+        docid_t  id     = 0;    //!< the id or 0 if the file was skipped
+        uint64_t tokens = 0;    //!< number of tokens
+        uint64_t terms  = 0;    //!< number of unique terms
+      };
+
+      //------------------------------------------------------------------------
+      //! Called for every processed file, one call at a time but from the
+      //! worker threads, not in order and before the ids are assigned
+      //------------------------------------------------------------------------
+      typedef std::function<void( const std::string &path,
+                                  const Document    &document )> Callback;
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param numThreads number of workers, 0 means one per core
+      //------------------------------------------------------------------------
+      IndexBuilder( unsigned numThreads = 0 );
+
+      //------------------------------------------------------------------------
+      //! Number of workers
+      //------------------------------------------------------------------------
+      unsigned numThreads() const
+      {
+        return pNumThreads;
+      }
+
+      //------------------------------------------------------------------------
+      //! Set the function called for every processed file
+      //------------------------------------------------------------------------
+      void setCallback( Callback callback )
+      {
+        pCallback = callback;
+      }
+
+      //------------------------------------------------------------------------
+      //! Build an index out of the files, they are added in order and under
+      //! their base names; the ones that cannot be read are skipped and get
+      //! no id
+      //!
+      //! @param index     a fresh index, possibly with the next document id
+      //!                  set; it is sealed afterwards
+      //! @param paths     the files
+      //! @param documents outcome for each of the files
+      //------------------------------------------------------------------------
+      void build( Index                          &index,
+                  const std::vector<std::string> &paths,
+                  std::vector<Document>          &documents );
+
+    private:
+      unsigned pNumThreads;
+      Callback pCallback;
+  };
+}
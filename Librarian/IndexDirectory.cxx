@@ -0,0 +1,345 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <Librarian/IndexDirectory.hh>
+#include <Librarian/Index.hh>
+#include <Librarian/IndexFile.hh>
+
+namespace
+{
+  const char     *gManifestName   = "MANIFEST";
+  const char     *gLockName       = "LOCK";
+  const char     *gManifestMagic  = "librarian-manifest";
+  const uint32_t  gManifestVersion = 2;
+
+  //----------------------------------------------------------------------------
+  // Name of the segment file with the given id
+  //----------------------------------------------------------------------------
+  std::string segmentName( uint64_t id )
+  {
+    char buffer[64];
+    snprintf( buffer, sizeof(buffer), "segment-%08llu.idx",
+              (unsigned long long)id );
+    return buffer;
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Destructor
+  //----------------------------------------------------------------------------
+  IndexDirectory::~IndexDirectory()
+  {
+    close();
+  }
+
+  //----------------------------------------------------------------------------
+  // Create a new, empty index
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::create( const std::string &path )
+  {
+    if( mkdir( path.c_str(), 0755 ) && errno != EEXIST )
+      return Status( Status::errIO, strerror( errno ) );
+
+    struct stat st;
+    if( stat( (path + "/" + gManifestName).c_str(), &st ) == 0 )
+      return Status( Status::errIO, "Index already exists" );
+
+    IndexDirectory dir;
+    bool           published;
+    dir.pPath = path;
+    return dir.storeManifest( published );
+  }
+
+  //----------------------------------------------------------------------------
+  // Open an index
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::open( const std::string &path, bool writable )
+  {
+    close();
+    pPath = path;
+
+    if( writable )
+    {
+      std::string lockName = path + "/" + gLockName;
+      pLockFd = ::open( lockName.c_str(), O_RDWR | O_CREAT, 0644 );
+      if( pLockFd < 0 || flock( pLockFd, LOCK_EX ) )
+      {
+        Status st( Status::errIO, strerror( errno ) );
+        close();
+        return st;
+      }
+    }
+
+    Status st = reload();
+    if( !st.isOK() )
+      close();
+    return st;
+  }
+
+  //----------------------------------------------------------------------------
+  // Close the index
+  //----------------------------------------------------------------------------
+  void IndexDirectory::close()
+  {
+    if( pLockFd >= 0 )
+      ::close( pLockFd );
+    pLockFd = -1;
+    pSegments.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  // Re-read the manifest
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::reload()
+  {
+    std::ifstream in( (pPath + "/" + gManifestName).c_str() );
+    if( !in.is_open() )
+      return Status( Status::errIO, "Unable to open the manifest: " +
+                     std::string( strerror( errno ) ) );
+
+    std::string magic, key;
+    uint32_t    version;
+    size_t      numSegments;
+    uint64_t    generation;
+    uint64_t    nextSegmentId;
+    docid_t     nextDocId;
+    in >> magic >> version;
+    if( !in.good() || magic != gManifestMagic )
+      return Status( Status::errIO, "Manifest corrupted" );
+    if( version != gManifestVersion )
+      return Status( Status::errIO, "Unsupported manifest version: " +
+                     std::to_string( version ) );
+
+    in >> key >> generation;
+    if( !in.good() || key != "generation" )
+      return Status( Status::errIO, "Manifest corrupted" );
+    in >> key >> nextSegmentId;
+    if( !in.good() || key != "next-segment-id" )
+      return Status( Status::errIO, "Manifest corrupted" );
+    in >> key >> nextDocId;
+    if( !in.good() || key != "next-doc-id" )
+      return Status( Status::errIO, "Manifest corrupted" );
+    in >> key >> numSegments;
+    if( !in.good() || key != "segments" )
+      return Status( Status::errIO, "Manifest corrupted" );
+
+    std::vector<Segment> segments( numSegments );
+    for( size_t i = 0; i < numSegments; ++i )
+    {
+      Segment &s = segments[i];
+      in >> s.name >> s.firstDocId >> s.endDocId;
+      if( in.fail() || s.firstDocId > s.endDocId || s.endDocId > nextDocId ||
+          (i > 0 && segments[i-1].endDocId > s.firstDocId) )
+        return Status( Status::errIO, "Manifest corrupted" );
+    }
+
+    std::lock_guard<std::mutex> lock( pMutex );
+    pGeneration    = generation;
+    pNextSegmentId = std::max( pNextSegmentId, nextSegmentId );
+    pNextDocId     = nextDocId;
+    pSegments.swap( segments );
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Write the manifest and move it in place; the file is flushed before it
+  // is renamed and the directory afterwards, so that a crash leaves either
+  // the old manifest or a complete new one
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::storeManifest( bool &published )
+  {
+    std::string name    = pPath + "/" + gManifestName;
+    std::string tmpName = name + ".tmp";
+    published = false;
+    {
+      std::ofstream out( tmpName.c_str(), std::ios::trunc );
+      if( !out.is_open() )
+        return Status( Status::errIO, strerror( errno ) );
+
+      out << gManifestMagic << " " << gManifestVersion << std::endl;
+      out << "generation " << pGeneration << std::endl;
+      out << "next-segment-id " << pNextSegmentId << std::endl;
+      out << "next-doc-id " << pNextDocId << std::endl;
+      out << "segments " << pSegments.size() << std::endl;
+      for( auto &s: pSegments )
+        out << s.name << " " << s.firstDocId << " " << s.endDocId << std::endl;
+      out.close();
+      if( out.fail() )
+      {
+        ::remove( tmpName.c_str() );
+        return Status( Status::errIO, strerror( errno ) );
+      }
+    }
+
+    Status st = syncFile( tmpName );
+    if( st.isOK() && ::rename( tmpName.c_str(), name.c_str() ) )
+      st = Status( Status::errIO, strerror( errno ) );
+    if( !st.isOK() )
+    {
+      ::remove( tmpName.c_str() );
+      return st;
+    }
+    published = true;
+    return syncFile( pPath );
+  }
+
+  //----------------------------------------------------------------------------
+  // Reserve a name for a new segment file
+  //----------------------------------------------------------------------------
+  std::string IndexDirectory::newSegmentName()
+  {
+    std::lock_guard<std::mutex> lock( pMutex );
+    return segmentName( pNextSegmentId++ );
+  }
+
+  //----------------------------------------------------------------------------
+  // Store the index as a new segment
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::addSegment( const Index &index )
+  {
+    if( pLockFd < 0 )
+      return Status( Status::errIO, "Index not open for writing" );
+
+    docid_t first = index.nextDocument( 0 );
+    docid_t end   = index.maxDocId()+1;
+
+    if( !first )
+      return Status();
+
+    //--------------------------------------------------------------------------
+    // The segment is written outside of the lock, the ids cannot go below
+    // the next one anyway since this is the only thread adding documents
+    //--------------------------------------------------------------------------
+    if( first < getNextDocId() )
+      return Status( Status::errIO, "Document ids overlap the index" );
+
+    Segment segment = { newSegmentName(), first, end };
+    Status st = index.dump( getSegmentPath( segment ) );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // Once the manifest is in place the segment stays, even if the
+    // directory could not be flushed
+    //--------------------------------------------------------------------------
+    std::lock_guard<std::mutex> lock( pMutex );
+    bool published;
+    pSegments.push_back( segment );
+    pNextDocId = end;
+    ++pGeneration;
+    st = storeManifest( published );
+    if( !published )
+    {
+      ::remove( getSegmentPath( segment ).c_str() );
+      pSegments.pop_back();
+      --pGeneration;
+    }
+    return st;
+  }
+
+  //----------------------------------------------------------------------------
+  // Replace a run of consecutive segments with one
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::replaceSegments( const std::vector<Segment> &old,
+                                          const Segment              &segment )
+  {
+    auto discard = [&]( const std::string &message )
+    {
+      ::remove( getSegmentPath( segment ).c_str() );
+      return Status( Status::errIO, message );
+    };
+    if( pLockFd < 0 )
+      return discard( "Index not open for writing" );
+    if( old.empty() )
+      return discard( "No segments to replace" );
+
+    std::lock_guard<std::mutex> lock( pMutex );
+    auto it = std::find_if( pSegments.begin(), pSegments.end(),
+                            [&old]( const Segment &s )
+                              { return s.name == old[0].name; } );
+    size_t first = it - pSegments.begin();
+    bool   found = first + old.size() <= pSegments.size();
+    for( size_t i = 0; found && i < old.size(); ++i )
+      found = pSegments[first+i].name == old[i].name;
+    if( !found )
+      return discard( "Segments to replace not found" );
+
+    std::vector<Segment> segments( pSegments.begin(), pSegments.begin()+first );
+    segments.push_back( segment );
+    segments.insert( segments.end(), pSegments.begin()+first+old.size(),
+                     pSegments.end() );
+    segments.swap( pSegments );
+    ++pGeneration;
+
+    //--------------------------------------------------------------------------
+    // The new segment is dropped if no manifest names it. If the manifest
+    // is in place but could not be flushed, the old one may still be what
+    // survives a crash, so the old segments are kept.
+    //--------------------------------------------------------------------------
+    bool   published;
+    Status st = storeManifest( published );
+    if( !published )
+    {
+      segments.swap( pSegments );
+      --pGeneration;
+      ::remove( getSegmentPath( segment ).c_str() );
+    }
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // Both the new segment and the manifest are durable now; the readers
+    // that have the old segments open keep them alive
+    //--------------------------------------------------------------------------
+    for( auto &s: old )
+      ::remove( getSegmentPath( s ).c_str() );
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Load all the segments into one in-memory index
+  //----------------------------------------------------------------------------
+  Status IndexDirectory::loadAll( Index &index ) const
+  {
+    index = Index();
+    for( auto &s: pSegments )
+    {
+      Index segment;
+      Status st = segment.load( getSegmentPath( s ) );
+      if( !st.isOK() )
+        return st;
+      index.merge( segment );
+    }
+    index.seal();
+    index.setNextDocId( std::max( index.maxDocId()+1, pNextDocId ) );
+    return Status();
+  }
+}
@@ -0,0 +1,186 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include <Librarian/Status.hh>
+#include <Librarian/PostingCodec.hh>
+
+namespace Librarian
+{
+  class Index;
+
+  //----------------------------------------------------------------------------
+  //! Index stored in a directory as a set of immutable segments listed in
+  //! a manifest. Every segment is a binary index file covering its own
+  //! range of document ids; the ranges are disjoint and ascending, so the
+  //! postings of a term are the postings of all the segments in order.
+  //!
+  //! New documents go to new segments and the manifest is replaced
+  //! atomically, so readers always see a consistent set of segments.
+  //! Writers serialize on a lock file; within the writer process the
+  //! segments may be added and merged from different threads.
+  //----------------------------------------------------------------------------
+  class IndexDirectory
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Segment description
+      //------------------------------------------------------------------------
+      struct Segment
+      {
+        std::string name;
+        docid_t     firstDocId;
+        docid_t     endDocId;
+      };
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      IndexDirectory() {}
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      ~IndexDirectory();
+
+      IndexDirectory( const IndexDirectory & ) = delete;
+      IndexDirectory &operator = ( const IndexDirectory & ) = delete;
+
+      //------------------------------------------------------------------------
+      //! Create a new, empty index
+      //------------------------------------------------------------------------
+      static Status create( const std::string &path );
+
+      //------------------------------------------------------------------------
+      //! Open an index
+      //!
+      //! @param writable take the writer lock, it is held until the index
+      //!                 is closed
+      //------------------------------------------------------------------------
+      Status open( const std::string &path, bool writable = false );
+
+      //------------------------------------------------------------------------
+      //! Close the index, releasing the writer lock
+      //------------------------------------------------------------------------
+      void close();
+
+      //------------------------------------------------------------------------
+      //! Re-read the manifest
+      //------------------------------------------------------------------------
+      Status reload();
+
+      //------------------------------------------------------------------------
+      //! Get the generation of the manifest, it grows with every change
+      //------------------------------------------------------------------------
+      uint64_t getGeneration() const
+      {
+        std::lock_guard<std::mutex> lock( pMutex );
+        return pGeneration;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the id the next document added to the index should get
+      //------------------------------------------------------------------------
+      docid_t getNextDocId() const
+      {
+        std::lock_guard<std::mutex> lock( pMutex );
+        return pNextDocId;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the live segments ordered by their document ids, not to be
+      //! used while other threads modify the index
+      //------------------------------------------------------------------------
+      const std::vector<Segment> &getSegments() const
+      {
+        return pSegments;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get a copy of the list of the live segments
+      //------------------------------------------------------------------------
+      std::vector<Segment> getSnapshot() const
+      {
+        std::lock_guard<std::mutex> lock( pMutex );
+        return pSegments;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the path to the index
+      //------------------------------------------------------------------------
+      const std::string &getPath() const
+      {
+        return pPath;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the path to the file of a segment
+      //------------------------------------------------------------------------
+      std::string getSegmentPath( const Segment &segment ) const
+      {
+        return pPath + "/" + segment.name;
+      }
+
+      //------------------------------------------------------------------------
+      //! Store the index as a new segment; all its documents need to have
+      //! ids not smaller than getNextDocId()
+      //------------------------------------------------------------------------
+      Status addSegment( const Index &index );
+
+      //------------------------------------------------------------------------
+      //! Reserve a name for a new segment file
+      //------------------------------------------------------------------------
+      std::string newSegmentName();
+
+      //------------------------------------------------------------------------
+      //! Replace a run of consecutive segments with one covering all their
+      //! documents; the files of the old segments are removed once the new
+      //! manifest is durable, the file of the new one if it cannot be
+      //! published
+      //------------------------------------------------------------------------
+      Status replaceSegments( const std::vector<Segment> &old,
+                              const Segment              &segment );
+
+      //------------------------------------------------------------------------
+      //! Load all the segments into one in-memory index
+      //------------------------------------------------------------------------
+      Status loadAll( Index &index ) const;
+
+    private:
+      //------------------------------------------------------------------------
+      // Write the manifest durably; published tells whether it has been
+      // moved in place, an error may come after that
+      //------------------------------------------------------------------------
+      Status storeManifest( bool &published );
+
+      std::string          pPath;
+      uint64_t             pGeneration    = 0;
+      uint64_t             pNextSegmentId = 1;
+      docid_t              pNextDocId     = 1;
+      std::vector<Segment> pSegments;
+      int                  pLockFd        = -1;
+      mutable std::mutex   pMutex;
+  };
+}
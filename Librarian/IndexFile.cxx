@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <Librarian/IndexFile.hh>
+#include <Librarian/Checksum.hh>
+
+static_assert( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+               "The index file format assumes a little-endian host" );
+static_assert( sizeof(Librarian::PostingList::BlockHeader) == 32,
+               "Unexpected block header layout" );
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Checksum of the header with the checksum field zeroed
+  //----------------------------------------------------------------------------
+  uint32_t headerChecksum( const Librarian::IndexFile::Header &header )
+  {
+    Librarian::IndexFile::Header h = header;
+    h.checksum = 0;
+    return Librarian::Checksum::update( 0, &h, sizeof(h) );
+  }
+
+  Librarian::Status corrupted( const std::string &what )
+  {
+    return Librarian::Status( Librarian::Status::errIO,
+                              "Index file corrupted: " + what );
+  }
+}
+
+namespace Librarian
+{
+  const char IndexFile::Magic[8] = { 'L', 'I', 'B', 'R', 'I', 'D', 'X', 0 };
+
+  //----------------------------------------------------------------------------
+  // Attach to the contents of an index file
+  //----------------------------------------------------------------------------
+  Status IndexFile::open( const void *data, uint64_t size, bool verify )
+  {
+    const uint8_t *base = (const uint8_t *)data;
+    pHeader = 0;
+
+    //--------------------------------------------------------------------------
+    // Check the header
+    //--------------------------------------------------------------------------
+    if( size < sizeof(Header) || memcmp( base, Magic, sizeof(Magic) ) )
+      return Status( Status::errIO, "Not a binary index file" );
+
+    const Header *header = (const Header *)base;
+    if( header->version != Version )
+      return Status( Status::errIO, "Unsupported index file version: " +
+                     std::to_string( header->version ) );
+
+    if( header->headerSize != sizeof(Header) ||
+        header->checksum != headerChecksum( *header ) )
+      return corrupted( "bad header" );
+
+    //--------------------------------------------------------------------------
+    // Check the sections
+    //--------------------------------------------------------------------------
+    for( int i = 0; i < NumSections; ++i )
+    {
+      const Section &s = header->sections[i];
+      if( s.offset % 8 || s.offset < sizeof(Header) || s.offset > size ||
+          s.length > size - s.offset )
+        return corrupted( "section out of bounds" );
+      if( verify && Checksum::update( 0, base+s.offset, s.length ) !=
+          s.checksum )
+        return corrupted( "checksum mismatch" );
+    }
+
+    //--------------------------------------------------------------------------
+    // The sizes of the tables need to match the header
+    //--------------------------------------------------------------------------
+    const Section *sections = header->sections;
+    if( sections[TermIndexSection].length % 8 ||
+        !pDictionary.open(
+          (const uint64_t *)(base + sections[TermIndexSection].offset),
+          sections[TermIndexSection].length / 8,
+          base + sections[TermBlocksSection].offset,
+          sections[TermBlocksSection].length, header->numTerms ) )
+      return corrupted( "bad term dictionary size" );
+
+    if( header->firstDocId == 0 || header->freeDocId < header->firstDocId ||
+        sections[DocOffsetsSection].length / 8 !=
+          header->freeDocId - header->firstDocId + 1 ||
+        sections[DocOffsetsSection].length % 8 )
+      return corrupted( "bad document table size" );
+
+    pHeader         = header;
+    pPostings       = base + sections[PostingsSection].offset;
+    pDocOffsets     = (const uint64_t *)(base +
+                                         sections[DocOffsetsSection].offset);
+    pDocNames       = (const char *)(base + sections[DocNamesSection].offset);
+    pDocNamesLength = sections[DocNamesSection].length;
+
+    if( !verify )
+      return Status();
+
+    Status st = validate();
+    if( !st.isOK() )
+      pHeader = 0;
+    return st;
+  }
+
+  //----------------------------------------------------------------------------
+  // Check whether the entry only points within the file
+  //----------------------------------------------------------------------------
+  bool IndexFile::isValid( const TermEntry &entry ) const
+  {
+    const Section  *s       = pHeader->sections;
+    const uint64_t  hdrSize = sizeof(PostingList::BlockHeader);
+    uint64_t        length  = s[PostingsSection].length;
+
+    return entry.postingsOffset % 8 == 0 && entry.postingsOffset <= length &&
+      entry.numBlocks <= (length - entry.postingsOffset) / hdrSize &&
+      entry.dataLength <= length - entry.postingsOffset -
+        entry.numBlocks*hdrSize;
+  }
+
+  //----------------------------------------------------------------------------
+  // Make sure that all the references stay within the file
+  //----------------------------------------------------------------------------
+  Status IndexFile::validate() const
+  {
+    uint64_t numDocs = pHeader->freeDocId - pHeader->firstDocId;
+
+    //--------------------------------------------------------------------------
+    // Terms need to be sorted and point to the postings of their own
+    //--------------------------------------------------------------------------
+    Status st = pDictionary.validate();
+    if( !st.isOK() )
+      return st;
+    for( auto it = pDictionary.begin(); it.valid(); it.next() )
+      if( !isValid( it.entry() ) )
+        return corrupted( "term entry out of bounds" );
+
+    //--------------------------------------------------------------------------
+    // Document offsets need to be ascending
+    //--------------------------------------------------------------------------
+    if( pDocOffsets[0] != 0 )
+      return corrupted( "bad document table" );
+    for( uint64_t i = 0; i < numDocs; ++i )
+      if( pDocOffsets[i+1] < pDocOffsets[i] )
+        return corrupted( "bad document table" );
+    if( pDocOffsets[numDocs] > pDocNamesLength )
+      return corrupted( "document name out of bounds" );
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Destructor
+  //----------------------------------------------------------------------------
+  IndexFileWriter::~IndexFileWriter()
+  {
+    if( pOut.is_open() )
+      pOut.close();
+    if( !pTmpName.empty() && !pCommitted )
+      ::remove( pTmpName.c_str() );
+  }
+
+  //----------------------------------------------------------------------------
+  // Open the file
+  //----------------------------------------------------------------------------
+  Status IndexFileWriter::open( const std::string &filename )
+  {
+    pFileName = filename;
+    pTmpName  = filename + ".tmp";
+    pOut.open( pTmpName.c_str(), std::ios::binary | std::ios::trunc );
+    if( !pOut.is_open() )
+      return Status( Status::errIO, strerror( errno ) );
+
+    memset( &pHeader, 0, sizeof(pHeader) );
+    memcpy( pHeader.magic, IndexFile::Magic, sizeof(pHeader.magic) );
+    pHeader.version    = IndexFile::Version;
+    pHeader.headerSize = sizeof(pHeader);
+    pOut.write( (const char *)&pHeader, sizeof(pHeader) );
+    pOffset = sizeof(pHeader);
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Start a new section
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::beginSection( IndexFile::SectionId section )
+  {
+    pSection = section;
+    pHeader.sections[section].offset   = pOffset;
+    pHeader.sections[section].length   = 0;
+    pHeader.sections[section].checksum = 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Append data to the current section
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::append( const void *data, size_t length )
+  {
+    IndexFile::Section &s = pHeader.sections[pSection];
+    pOut.write( (const char *)data, length );
+    s.checksum  = Checksum::update( s.checksum, data, length );
+    s.length   += length;
+    pOffset    += length;
+  }
+
+  //----------------------------------------------------------------------------
+  // Append the postings of a term
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::appendPostings( const PostingList    &postings,
+                                        IndexFile::TermEntry &entry )
+  {
+    std::vector<PostingList::BlockHeader> tailHeaders;
+    std::vector<uint8_t>                  tailData;
+    postings.encodeTail( tailHeaders, tailData );
+    for( auto &h: tailHeaders )
+      h.offset += postings.dataLength();
+
+    entry.postingsOffset = sectionOffset();
+    entry.numBlocks      = postings.numBlocks() + tailHeaders.size();
+    entry.dataLength     = postings.dataLength() + tailData.size();
+    entry.numPostings    = postings.size();
+
+    if( postings.numBlocks() )
+      append( &postings.getBlockHeader( 0 ),
+              postings.numBlocks()*sizeof(PostingList::BlockHeader) );
+    append( tailHeaders.data(),
+            tailHeaders.size()*sizeof(PostingList::BlockHeader) );
+    append( postings.getData(), postings.dataLength() );
+    append( tailData.data(), tailData.size() );
+    align();
+  }
+
+  //----------------------------------------------------------------------------
+  // Write the TermIndex and TermBlocks sections
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::appendDictionary(
+    const TermDictionaryWriter &dictionary )
+  {
+    std::vector<uint64_t> index = dictionary.getIndex();
+    beginSection( IndexFile::TermIndexSection );
+    append( index.data(), index.size()*sizeof(uint64_t) );
+    endSection();
+
+    beginSection( IndexFile::TermBlocksSection );
+    append( dictionary.getData().data(), dictionary.getData().size() );
+    endSection();
+  }
+
+  //----------------------------------------------------------------------------
+  // Pad the current section to 8 bytes
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::align()
+  {
+    static const uint8_t zeros[8] = { 0 };
+    if( pOffset % 8 )
+      append( zeros, 8 - pOffset % 8 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Finish the current section
+  //----------------------------------------------------------------------------
+  void IndexFileWriter::endSection()
+  {
+    align();
+    pSection = -1;
+  }
+
+  //----------------------------------------------------------------------------
+  // Write the header and move the file in place
+  //----------------------------------------------------------------------------
+  Status IndexFileWriter::commit( uint64_t numTerms,   uint64_t numDocuments,
+                                  uint64_t firstDocId, uint64_t freeDocId )
+  {
+    pHeader.numTerms     = numTerms;
+    pHeader.numDocuments = numDocuments;
+    pHeader.firstDocId   = firstDocId;
+    pHeader.freeDocId    = freeDocId;
+    pHeader.checksum     = headerChecksum( pHeader );
+    pOut.seekp( 0 );
+    pOut.write( (const char *)&pHeader, sizeof(pHeader) );
+    pOut.close();
+    if( pOut.fail() )
+      return Status( Status::errIO, strerror( errno ) );
+
+    Status st = syncFile( pTmpName );
+    if( !st.isOK() )
+      return st;
+    if( ::rename( pTmpName.c_str(), pFileName.c_str() ) )
+      return Status( Status::errIO, strerror( errno ) );
+    pCommitted = true;
+
+    size_t slash = pFileName.rfind( '/' );
+    return syncFile( slash == std::string::npos ? "." :
+                     slash == 0 ? "/" : pFileName.substr( 0, slash ) );
+  }
+
+  //----------------------------------------------------------------------------
+  // Flush a file or a directory to the disk
+  //----------------------------------------------------------------------------
+  Status syncFile( const std::string &path )
+  {
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+      return Status( Status::errIO, strerror( errno ) );
+    int ret = ::fsync( fd );
+    int err = errno;
+    ::close( fd );
+    if( ret )
+      return Status( Status::errIO, strerror( err ) );
+    return Status();
+  }
+}
@@ -0,0 +1,297 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <Librarian/Status.hh>
+#include <Librarian/Postings.hh>
+#include <Librarian/TermDictionary.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Binary index file layout
+  //!
+  //! The file starts with a fixed size header followed by a number of
+  //! sections, each of them aligned to 8 bytes and protected by a CRC-32C
+  //! checksum kept in the header. All the integers are stored in the
+  //! native (little-endian) byte order, and every section is laid out so
+  //! that it can be used in place once the file is mapped to memory:
+  //!
+  //! - Postings:   for every term, its block headers (PostingList::BlockHeader)
+  //!               followed by the block data, padded to 8 bytes
+  //! - TermIndex:  offsets of the term dictionary blocks in TermBlocks,
+  //!               followed by the length of TermBlocks (TermDictionary)
+  //! - TermBlocks: front-coded blocks of the sorted term dictionary
+  //! - DocOffsets: freeDocId-firstDocId+1 offsets into DocNames, the name of
+  //!               document id spans [offset[i], offset[i+1]) where
+  //!               i = id-firstDocId; an empty span marks an unused id
+  //! - DocNames:   document names, back to back
+  //----------------------------------------------------------------------------
+  class IndexFile
+  {
+    public:
+      static const uint32_t Version = 3;
+      static const char     Magic[8];
+
+      enum SectionId
+      {
+        PostingsSection   = 0,
+        TermIndexSection  = 1,
+        TermBlocksSection = 2,
+        DocOffsetsSection = 3,
+        DocNamesSection   = 4,
+        NumSections       = 5
+      };
+
+      //------------------------------------------------------------------------
+      //! Location of a section within the file
+      //------------------------------------------------------------------------
+      struct Section
+      {
+        uint64_t offset;
+        uint64_t length;
+        uint32_t checksum;
+        uint32_t reserved;
+      };
+
+      //------------------------------------------------------------------------
+      //! File header, the checksum covers the header with the checksum
+      //! field set to 0
+      //------------------------------------------------------------------------
+      struct Header
+      {
+        char     magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t numTerms;
+        uint64_t numDocuments;
+        uint64_t firstDocId;
+        uint64_t freeDocId;
+        Section  sections[NumSections];
+        uint32_t reserved;
+        uint32_t checksum;
+      };
+
+      typedef TermDictionary::Entry TermEntry;
+
+      //------------------------------------------------------------------------
+      //! Attach to the contents of an index file; the header and the
+      //! section sizes are always checked, the rest of the file is only
+      //! looked at when asked to verify it
+      //!
+      //! @param data   file contents, aligned to 8 bytes
+      //! @param size   size of the contents
+      //! @param verify verify the section checksums and all the term and
+      //!               document table entries
+      //------------------------------------------------------------------------
+      Status open( const void *data, uint64_t size, bool verify = true );
+
+      //------------------------------------------------------------------------
+      //! Get the header
+      //------------------------------------------------------------------------
+      const Header &getHeader() const
+      {
+        return *pHeader;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the number of terms
+      //------------------------------------------------------------------------
+      uint64_t numTerms() const
+      {
+        return pHeader->numTerms;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the term dictionary
+      //------------------------------------------------------------------------
+      const TermDictionary &getDictionary() const
+      {
+        return pDictionary;
+      }
+
+      //------------------------------------------------------------------------
+      //! Check whether the entry only points within the file
+      //------------------------------------------------------------------------
+      bool isValid( const TermEntry &entry ) const;
+
+      //------------------------------------------------------------------------
+      //! Find a term in the dictionary, the entry needs to be valid
+      //------------------------------------------------------------------------
+      bool findTerm( std::string_view term, TermEntry &entry ) const
+      {
+        return pDictionary.find( term, entry ) && isValid( entry );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the block headers of a term
+      //------------------------------------------------------------------------
+      const PostingList::BlockHeader *getBlockHeaders(
+        const TermEntry &entry ) const
+      {
+        return (const PostingList::BlockHeader *)(pPostings +
+                                                  entry.postingsOffset);
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the block data of a term
+      //------------------------------------------------------------------------
+      const uint8_t *getBlockData( const TermEntry &entry ) const
+      {
+        return pPostings + entry.postingsOffset +
+          entry.numBlocks*sizeof(PostingList::BlockHeader);
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the name of a document, empty if the id is not in use
+      //------------------------------------------------------------------------
+      std::string_view getDocumentName( docid_t id ) const
+      {
+        if( id < pHeader->firstDocId || id >= pHeader->freeDocId )
+          return std::string_view();
+        uint64_t begin = pDocOffsets[id-pHeader->firstDocId];
+        uint64_t end   = pDocOffsets[id-pHeader->firstDocId+1];
+        if( begin > end || end > pDocNamesLength )
+          return std::string_view();
+        return std::string_view( pDocNames + begin, end - begin );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the offsets of the document names, one per id from the first
+      //! document to the free one, inclusive
+      //------------------------------------------------------------------------
+      const uint64_t *getDocumentOffsets() const
+      {
+        return pDocOffsets;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the document names
+      //------------------------------------------------------------------------
+      const char *getDocumentNames() const
+      {
+        return pDocNames;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the length of the document names
+      //------------------------------------------------------------------------
+      uint64_t getDocumentNamesLength() const
+      {
+        return pDocNamesLength;
+      }
+
+    private:
+      Status validate() const;
+
+      const Header   *pHeader         = 0;
+      uint64_t        pDocNamesLength = 0;
+      const uint8_t  *pPostings       = 0;
+      TermDictionary  pDictionary;
+      const uint64_t *pDocOffsets     = 0;
+      const char     *pDocNames       = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Write an index file section by section; the data goes to a temporary
+  //! file that replaces the target only once the header is committed
+  //----------------------------------------------------------------------------
+  class IndexFileWriter
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Destructor, discards the file if it was not committed
+      //------------------------------------------------------------------------
+      ~IndexFileWriter();
+
+      //------------------------------------------------------------------------
+      //! Open the file
+      //------------------------------------------------------------------------
+      Status open( const std::string &filename );
+
+      //------------------------------------------------------------------------
+      //! Start a new section
+      //------------------------------------------------------------------------
+      void beginSection( IndexFile::SectionId section );
+
+      //------------------------------------------------------------------------
+      //! Append data to the current section
+      //------------------------------------------------------------------------
+      void append( const void *data, size_t length );
+
+      //------------------------------------------------------------------------
+      //! Append the postings of a term to the postings section, the tail
+      //! gets encoded on the way; fills in the entry
+      //------------------------------------------------------------------------
+      void appendPostings( const PostingList &postings,
+                           IndexFile::TermEntry &entry );
+
+      //------------------------------------------------------------------------
+      //! Write the TermIndex and TermBlocks sections
+      //------------------------------------------------------------------------
+      void appendDictionary( const TermDictionaryWriter &dictionary );
+
+      //------------------------------------------------------------------------
+      //! Pad the current section to 8 bytes
+      //------------------------------------------------------------------------
+      void align();
+
+      //------------------------------------------------------------------------
+      //! Offset within the current section
+      //------------------------------------------------------------------------
+      uint64_t sectionOffset() const
+      {
+        return pOffset - pHeader.sections[pSection].offset;
+      }
+
+      //------------------------------------------------------------------------
+      //! Finish the current section
+      //------------------------------------------------------------------------
+      void endSection();
+
+      //------------------------------------------------------------------------
+      //! Write the header and move the file in place; the file is flushed
+      //! to the disk before it is renamed and its directory afterwards, so
+      //! that it is durable once this returns
+      //------------------------------------------------------------------------
+      Status commit( uint64_t numTerms,   uint64_t numDocuments,
+                     uint64_t firstDocId, uint64_t freeDocId );
+
+    private:
+      std::ofstream     pOut;
+      std::string       pFileName;
+      std::string       pTmpName;
+      IndexFile::Header pHeader;
+      uint64_t          pOffset    = 0;
+      int               pSection   = -1;
+      bool              pCommitted = false;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Flush a file, or the entries of a directory, to the disk
+  //----------------------------------------------------------------------------
+  Status syncFile( const std::string &path );
+}
@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include <Librarian/Postings.hh>
+
+namespace Librarian
+{
+  class Bitmap;
+
+  //----------------------------------------------------------------------------
+  //! Read-only access to a search index, as needed to run queries
+  //----------------------------------------------------------------------------
+  class IndexReader
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Called for every visited term with all of its postings, returns
+      //! false to stop the enumeration
+      //------------------------------------------------------------------------
+      typedef std::function<bool( std::string_view     term,
+                                  const TermPostings  &postings )> TermVisitor;
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~IndexReader() {}
+
+      //------------------------------------------------------------------------
+      //! Find the postings of a term
+      //!
+      //! @return false if the term is not in the index
+      //------------------------------------------------------------------------
+      virtual bool findTerm( std::string_view  term,
+                             TermPostings     &postings ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms starting with the prefix in lexicographical
+      //! order, the empty prefix visits the whole dictionary
+      //------------------------------------------------------------------------
+      virtual void visitTerms( std::string_view   prefix,
+                               const TermVisitor &visitor ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms within the edit distance from the term in
+      //! lexicographical order
+      //------------------------------------------------------------------------
+      virtual void visitSimilarTerms( std::string_view   term,
+                                      uint32_t           maxDistance,
+                                      const TermVisitor &visitor ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get document name for the given id, empty if there is no such
+      //! document
+      //------------------------------------------------------------------------
+      virtual std::string_view getDocumentName( docid_t id ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get the first document with an id larger than the given one
+      //!
+      //! @return 0 if there is none
+      //------------------------------------------------------------------------
+      virtual docid_t nextDocument( docid_t id ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents in use, the bitmap needs to be
+      //! large enough to hold maxDocId
+      //------------------------------------------------------------------------
+      virtual void fillDocuments( Bitmap &bitmap ) const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get number of documents
+      //------------------------------------------------------------------------
+      virtual docid_t numDocuments() const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get the largest document id in use
+      //------------------------------------------------------------------------
+      virtual docid_t maxDocId() const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get the version of the contents, it changes whenever documents or
+      //! postings come or go, so that whatever has been computed from them
+      //! can be dropped
+      //------------------------------------------------------------------------
+      virtual uint64_t getVersion() const = 0;
+  };
+}
@@ -0,0 +1,301 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <utility>
+
+#include <Librarian/IntersectionKernels.hh>
+#include <Librarian/Bitmap.hh>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBRARIAN_X86 1
+#endif
+
+using Librarian::docid_t;
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Merge the remainders of the lists without branching on the comparison
+  //----------------------------------------------------------------------------
+  inline size_t mergeTail( const docid_t *a, size_t i, size_t na,
+                           const docid_t *b, size_t j, size_t nb,
+                           docid_t       *out, size_t k )
+  {
+    while( i < na && j < nb )
+    {
+      docid_t x = a[i];
+      docid_t y = b[j];
+      if( x == y )
+        out[k++] = x;
+      i += x <= y;
+      j += y <= x;
+    }
+    return k;
+  }
+
+  size_t blockScalar( const docid_t *a, size_t na,
+                      const docid_t *b, size_t nb,
+                      docid_t       *out )
+  {
+    return mergeTail( a, 0, na, b, 0, nb, out, 0 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Copy out the ids of a block selected by the match mask; the block has
+  // been read into a register, so out may overwrite it
+  //----------------------------------------------------------------------------
+  inline size_t emit( const docid_t *block, uint32_t mask,
+                      docid_t *out, size_t k )
+  {
+    while( mask )
+    {
+      out[k++] = block[__builtin_ctz( mask )];
+      mask &= mask-1;
+    }
+    return k;
+  }
+
+#ifdef LIBRARIAN_X86
+  //----------------------------------------------------------------------------
+  // SSE2 has no 64-bit comparison: two 32-bit halves are equal when both
+  // of them are
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse2")))
+  inline __m128i equal64( __m128i x, __m128i y )
+  {
+    __m128i eq = _mm_cmpeq_epi32( x, y );
+    return _mm_and_si128( eq, _mm_shuffle_epi32( eq, 0xb1 ) );
+  }
+
+  //----------------------------------------------------------------------------
+  // Compare four ids of a with four ids of b, all pairs, and move the block
+  // with the smaller maximum forward; the blocks are held in two registers
+  // of two ids each and the ones of b are compared swapped as well
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse2")))
+  size_t blockSSE2( const docid_t *a, size_t na,
+                    const docid_t *b, size_t nb,
+                    docid_t       *out )
+  {
+    alignas(16) docid_t block[4];
+    size_t i = 0, j = 0, k = 0;
+    while( i+4 <= na && j+4 <= nb )
+    {
+      __m128i a0 = _mm_loadu_si128( (const __m128i*)(a+i) );
+      __m128i a1 = _mm_loadu_si128( (const __m128i*)(a+i+2) );
+      __m128i b0 = _mm_loadu_si128( (const __m128i*)(b+j) );
+      __m128i b1 = _mm_loadu_si128( (const __m128i*)(b+j+2) );
+      __m128i s0 = _mm_shuffle_epi32( b0, 0x4e );
+      __m128i s1 = _mm_shuffle_epi32( b1, 0x4e );
+
+      __m128i m0 = _mm_or_si128(
+        _mm_or_si128( equal64( a0, b0 ), equal64( a0, s0 ) ),
+        _mm_or_si128( equal64( a0, b1 ), equal64( a0, s1 ) ) );
+      __m128i m1 = _mm_or_si128(
+        _mm_or_si128( equal64( a1, b0 ), equal64( a1, s0 ) ),
+        _mm_or_si128( equal64( a1, b1 ), equal64( a1, s1 ) ) );
+      uint32_t mask = _mm_movemask_pd( _mm_castsi128_pd( m0 ) ) |
+                      _mm_movemask_pd( _mm_castsi128_pd( m1 ) ) << 2;
+
+      docid_t amax = a[i+3];
+      docid_t bmax = b[j+3];
+      if( mask )
+      {
+        _mm_store_si128( (__m128i*)block, a0 );
+        _mm_store_si128( (__m128i*)(block+2), a1 );
+        k = emit( block, mask, out, k );
+      }
+      i += (amax <= bmax) * 4;
+      j += (bmax <= amax) * 4;
+    }
+    return mergeTail( a, i, na, b, j, nb, out, k );
+  }
+
+  //----------------------------------------------------------------------------
+  // The same with AVX2, the four ids of a block fit a single register and
+  // b is rotated three times
+  //----------------------------------------------------------------------------
+  __attribute__((target("avx2")))
+  size_t blockAVX2( const docid_t *a, size_t na,
+                    const docid_t *b, size_t nb,
+                    docid_t       *out )
+  {
+    alignas(32) docid_t block[4];
+    size_t i = 0, j = 0, k = 0;
+    while( i+4 <= na && j+4 <= nb )
+    {
+      __m256i va = _mm256_loadu_si256( (const __m256i*)(a+i) );
+      __m256i vb = _mm256_loadu_si256( (const __m256i*)(b+j) );
+      __m256i m  = _mm256_or_si256(
+        _mm256_or_si256(
+          _mm256_cmpeq_epi64( va, vb ),
+          _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ) ) ),
+        _mm256_or_si256(
+          _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e ) ),
+          _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ) ) ) );
+      uint32_t mask = _mm256_movemask_pd( _mm256_castsi256_pd( m ) );
+
+      docid_t amax = a[i+3];
+      docid_t bmax = b[j+3];
+      if( mask )
+      {
+        _mm256_store_si256( (__m256i*)block, va );
+        k = emit( block, mask, out, k );
+      }
+      i += (amax <= bmax) * 4;
+      j += (bmax <= amax) * 4;
+    }
+    return mergeTail( a, i, na, b, j, nb, out, k );
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  // Pick the block kernel for the CPU we run on
+  //----------------------------------------------------------------------------
+  struct Kernels
+  {
+    typedef size_t (*BlockFn)( const docid_t*, size_t,
+                               const docid_t*, size_t, docid_t* );
+
+    Kernels()
+    {
+#ifdef LIBRARIAN_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "avx2" ) )
+      {
+        block = blockAVX2;
+        name  = "avx2";
+      }
+      else if( __builtin_cpu_supports( "sse2" ) )
+      {
+        block = blockSSE2;
+        name  = "sse2";
+      }
+#endif
+    }
+    BlockFn     block = blockScalar;
+    const char *name  = "scalar";
+  };
+  const Kernels gKernels;
+}
+
+namespace Librarian
+{
+  const size_t IntersectionKernels::GallopRatio;
+
+  //----------------------------------------------------------------------------
+  // Pick the kernel by the ratio of the lengths
+  //----------------------------------------------------------------------------
+  size_t IntersectionKernels::intersect( const docid_t *a, size_t na,
+                                         const docid_t *b, size_t nb,
+                                         docid_t       *out )
+  {
+    size_t shorter = std::min( na, nb );
+    if( !shorter )
+      return 0;
+    if( std::max( na, nb ) / shorter >= GallopRatio )
+      return gallop( a, na, b, nb, out );
+    return gKernels.block( a, na, b, nb, out );
+  }
+
+  //----------------------------------------------------------------------------
+  // Scalar merge
+  //----------------------------------------------------------------------------
+  size_t IntersectionKernels::merge( const docid_t *a, size_t na,
+                                     const docid_t *b, size_t nb,
+                                     docid_t       *out )
+  {
+    return blockScalar( a, na, b, nb, out );
+  }
+
+  //----------------------------------------------------------------------------
+  // Vectorized block merge
+  //----------------------------------------------------------------------------
+  size_t IntersectionKernels::block( const docid_t *a, size_t na,
+                                     const docid_t *b, size_t nb,
+                                     docid_t       *out )
+  {
+    return gKernels.block( a, na, b, nb, out );
+  }
+
+  //----------------------------------------------------------------------------
+  // Gallop the shorter list over the longer one; every match moves both
+  // lists forward, so the output never overtakes either of them
+  //----------------------------------------------------------------------------
+  size_t IntersectionKernels::gallop( const docid_t *a, size_t na,
+                                      const docid_t *b, size_t nb,
+                                      docid_t       *out )
+  {
+    if( na > nb )
+    {
+      std::swap( a, b );
+      std::swap( na, nb );
+    }
+
+    size_t k = 0, j = 0;
+    for( size_t i = 0; i < na && j < nb; ++i )
+    {
+      docid_t id   = a[i];
+      size_t  lo   = j;
+      size_t  hi   = j;
+      size_t  step = 1;
+      while( hi < nb && b[hi] < id )
+      {
+        lo    = hi+1;
+        hi    = j+step;
+        step *= 2;
+      }
+      hi = std::min( hi, nb );
+      j  = std::lower_bound( b+lo, b+hi, id ) - b;
+      if( j < nb && b[j] == id )
+      {
+        out[k++] = id;
+        ++j;
+      }
+    }
+    return k;
+  }
+
+  //----------------------------------------------------------------------------
+  // Probe the bitmap
+  //----------------------------------------------------------------------------
+  size_t IntersectionKernels::filter( const docid_t *a, size_t na,
+                                      const Bitmap  &bitmap,
+                                      docid_t       *out )
+  {
+    size_t k = 0;
+    for( size_t i = 0; i < na; ++i )
+    {
+      docid_t id = a[i];
+      out[k] = id;
+      k += id < bitmap.size() && bitmap.test( id );
+    }
+    return k;
+  }
+
+  //----------------------------------------------------------------------------
+  // Name of the block kernel
+  //----------------------------------------------------------------------------
+  const char *IntersectionKernels::kernelName()
+  {
+    return gKernels.name;
+  }
+}
@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+
+#include <Librarian/PostingCodec.hh>
+
+namespace Librarian
+{
+  class Bitmap;
+
+  //----------------------------------------------------------------------------
+  //! Intersection kernels for sorted arrays of unique document ids
+  //!
+  //! The output may be the first input array, the results are written
+  //! behind the read position, otherwise it must have room for the
+  //! smaller of the two inputs. The block kernel compares four ids of one
+  //! list with four ids of the other at a time, all pairs at once, with
+  //! AVX2 or SSE2; the best implementation the CPU supports is picked at
+  //! run time.
+  //----------------------------------------------------------------------------
+  class IntersectionKernels
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Above this size ratio the shorter list gallops over the longer one
+      //------------------------------------------------------------------------
+      static const size_t GallopRatio = 64;
+
+      //------------------------------------------------------------------------
+      //! Intersect the arrays with the kernel suited to their lengths
+      //!
+      //! @return number of ids written to out
+      //------------------------------------------------------------------------
+      static size_t intersect( const docid_t *a, size_t na,
+                               const docid_t *b, size_t nb,
+                               docid_t       *out );
+
+      //------------------------------------------------------------------------
+      //! Scalar merge, one comparison per step
+      //------------------------------------------------------------------------
+      static size_t merge( const docid_t *a, size_t na,
+                           const docid_t *b, size_t nb,
+                           docid_t       *out );
+
+      //------------------------------------------------------------------------
+      //! Vectorized block merge
+      //------------------------------------------------------------------------
+      static size_t block( const docid_t *a, size_t na,
+                           const docid_t *b, size_t nb,
+                           docid_t       *out );
+
+      //------------------------------------------------------------------------
+      //! Look up every id of the shorter list in the longer one with an
+      //! exponential search starting from the previous match
+      //------------------------------------------------------------------------
+      static size_t gallop( const docid_t *a, size_t na,
+                            const docid_t *b, size_t nb,
+                            docid_t       *out );
+
+      //------------------------------------------------------------------------
+      //! Keep the ids of the array that are set in the bitmap
+      //------------------------------------------------------------------------
+      static size_t filter( const docid_t *a, size_t na,
+                            const Bitmap  &bitmap,
+                            docid_t       *out );
+
+      //------------------------------------------------------------------------
+      //! Name of the block kernel selected for this CPU
+      //------------------------------------------------------------------------
+      static const char *kernelName();
+  };
+}
@@ -0,0 +1,240 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Values keyed by strings, evicted by LRU within a byte budget and all
+  //! dropped when the version of the index they come from changes
+  //!
+  //! The cache may be segmented: a new entry then goes on probation and is
+  //! protected only once it is hit, and the protected entries may take
+  //! a share of the budget, so that a burst of keys seen once does not
+  //! push out the ones that repeat. With no share for them, the cache is
+  //! a plain LRU.
+  //----------------------------------------------------------------------------
+  template<typename Value>
+  class LRUCache
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Counters of the cache
+      //------------------------------------------------------------------------
+      struct Statistics
+      {
+        uint64_t hits          = 0; //!< lookups that found the key
+        uint64_t misses        = 0; //!< lookups that did not
+        uint64_t evictions     = 0; //!< entries removed to make room
+        uint64_t invalidations = 0; //!< entries dropped for a new version
+        uint64_t entries       = 0; //!< entries held
+        uint64_t bytes         = 0; //!< bytes held
+      };
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param budget         maximal number of bytes the entries may take
+      //! @param protectedShare percentage of the budget the protected
+      //!                       entries may take, 0 for a plain LRU
+      //------------------------------------------------------------------------
+      LRUCache( size_t budget, size_t protectedShare = 0 ):
+        pBudget( budget ), pProtectedShare( protectedShare ) {}
+
+      LRUCache( const LRUCache & ) = delete;
+      LRUCache &operator = ( const LRUCache & ) = delete;
+
+      //------------------------------------------------------------------------
+      //! Find the value of a key and make it the most recently used one
+      //!
+      //! @param version version of the index the value needs to match
+      //! @return        the value or null if the key is not cached; it
+      //!                stays valid until the next insert or clear
+      //------------------------------------------------------------------------
+      const Value *find( const std::string &key, uint64_t version )
+      {
+        validate( version );
+        auto it = pEntries.find( key );
+        if( it == pEntries.end() )
+        {
+          ++pStats.misses;
+          return nullptr;
+        }
+        ++pStats.hits;
+        touch( it->second );
+        return &it->second->value;
+      }
+
+      //------------------------------------------------------------------------
+      //! Check whether a key is cached, without counting a lookup
+      //------------------------------------------------------------------------
+      bool contains( const std::string &key, uint64_t version )
+      {
+        validate( version );
+        return pEntries.count( key );
+      }
+
+      //------------------------------------------------------------------------
+      //! Store the value of a key unless it is there already; the entries
+      //! that would take more than the whole budget are not stored
+      //!
+      //! @param size    number of bytes the value takes besides its object
+      //! @param version version of the index the value comes from
+      //------------------------------------------------------------------------
+      void insert( const std::string &key,
+                   Value              value,
+                   size_t             size,
+                   uint64_t           version )
+      {
+        if( contains( key, version ) )
+          return;
+
+        Entry entry;
+        entry.key   = key;
+        entry.value = std::move( value );
+        entry.bytes = sizeof(Entry) + entry.key.capacity() + size +
+                      sizeof(typename Map::value_type) + 4*sizeof(void*);
+        if( entry.bytes > pBudget )
+          return;
+
+        pProbation.push_front( std::move( entry ) );
+        pEntries.emplace( pProbation.front().key, pProbation.begin() );
+        pStats.bytes += pProbation.front().bytes;
+        ++pStats.entries;
+        evict();
+      }
+
+      //------------------------------------------------------------------------
+      //! Drop all the entries
+      //------------------------------------------------------------------------
+      void clear()
+      {
+        pEntries.clear();
+        pProbation.clear();
+        pProtected.clear();
+        pProtectedBytes = 0;
+        pStats.entries  = 0;
+        pStats.bytes    = 0;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the counters
+      //------------------------------------------------------------------------
+      const Statistics &getStatistics() const
+      {
+        return pStats;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the maximal number of bytes the entries may take
+      //------------------------------------------------------------------------
+      size_t getBudget() const
+      {
+        return pBudget;
+      }
+
+    private:
+      struct Entry
+      {
+        std::string key;
+        Value       value;
+        size_t      bytes   = 0;
+        bool        protect = false;
+      };
+      typedef std::list<Entry>                                      List;
+      typedef std::unordered_map<std::string_view, typename List::iterator>
+        Map;
+
+      //------------------------------------------------------------------------
+      // Make an entry the most recently used one; in a segmented cache a
+      // hit on probation protects it and the least recently used protected
+      // entries go back on probation if there are too many of them
+      //------------------------------------------------------------------------
+      void touch( typename List::iterator entry )
+      {
+        if( !pProtectedShare )
+          pProbation.splice( pProbation.begin(), pProbation, entry );
+        else if( entry->protect )
+          pProtected.splice( pProtected.begin(), pProtected, entry );
+        else
+        {
+          entry->protect    = true;
+          pProtectedBytes  += entry->bytes;
+          pProtected.splice( pProtected.begin(), pProbation, entry );
+          while( pProtectedBytes > pBudget/100*pProtectedShare &&
+                 pProtected.size() > 1 )
+          {
+            auto last = std::prev( pProtected.end() );
+            last->protect     = false;
+            pProtectedBytes  -= last->bytes;
+            pProbation.splice( pProbation.begin(), pProtected, last );
+          }
+        }
+      }
+
+      //------------------------------------------------------------------------
+      // Drop all the entries if they come from another version of the index
+      //------------------------------------------------------------------------
+      void validate( uint64_t version )
+      {
+        if( version == pVersion )
+          return;
+        pStats.invalidations += pStats.entries;
+        clear();
+        pVersion = version;
+      }
+
+      //------------------------------------------------------------------------
+      // Remove the least recently used entries on probation, then the
+      // protected ones, until the rest fits in the budget
+      //------------------------------------------------------------------------
+      void evict()
+      {
+        while( pStats.bytes > pBudget )
+        {
+          List &list = pProbation.empty() ? pProtected : pProbation;
+          auto  last = std::prev( list.end() );
+          if( last->protect )
+            pProtectedBytes -= last->bytes;
+          pStats.bytes -= last->bytes;
+          --pStats.entries;
+          ++pStats.evictions;
+          pEntries.erase( last->key );
+          list.erase( last );
+        }
+      }
+
+      size_t     pBudget;
+      size_t     pProtectedShare;
+      size_t     pProtectedBytes = 0;
+      uint64_t   pVersion        = 0;
+      List       pProbation;
+      List       pProtected;
+      Map        pEntries;
+      Statistics pStats;
+  };
+}
@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include <Librarian/LevenshteinAutomaton.hh>
+
+namespace Librarian
+{
+  const uint32_t LevenshteinAutomaton::MaxDistance;
+  const uint32_t LevenshteinAutomaton::Dead;
+  const uint32_t LevenshteinAutomaton::Unknown;
+
+  //----------------------------------------------------------------------------
+  // Constructor
+  //----------------------------------------------------------------------------
+  LevenshteinAutomaton::LevenshteinAutomaton( std::string_view term,
+                                              uint32_t         maxDistance ):
+    pTerm( term ),
+    pMaxDistance( std::min( maxDistance, MaxDistance ) ),
+    pWidth( term.size()+1 ),
+    pNext( term.size()+1 )
+  {
+    //--------------------------------------------------------------------------
+    // The dead state goes first so that it gets the zero id
+    //--------------------------------------------------------------------------
+    std::vector<uint8_t> row( pWidth, pMaxDistance+1 );
+    addState( row.data() );
+
+    for( size_t i = 0; i < pWidth; ++i )
+      row[i] = std::min<size_t>( i, pMaxDistance+1 );
+    pStart = addState( row.data() );
+  }
+
+  //----------------------------------------------------------------------------
+  // Compute the next row of the matrix
+  //----------------------------------------------------------------------------
+  uint32_t LevenshteinAutomaton::computeStep( uint32_t state, char ch )
+  {
+    if( state == Dead )
+      return Dead;
+
+    uint8_t        limit = pMaxDistance+1;
+    uint8_t       *next  = pNext.data();
+    const uint8_t *row   = &pRows[state*pWidth];
+    next[0] = std::min<uint8_t>( row[0]+1, limit );
+    bool alive = next[0] < limit;
+    for( size_t i = 1; i < pWidth; ++i )
+    {
+      uint8_t d = row[i-1] + (pTerm[i-1] != ch);
+      d = std::min<uint8_t>( d, row[i]+1 );
+      d = std::min<uint8_t>( d, next[i-1]+1 );
+      next[i] = std::min( d, limit );
+      alive |= next[i] < limit;
+    }
+    if( !alive )
+      return Dead;
+    return addState( next );
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the state of a row or add a new one
+  //----------------------------------------------------------------------------
+  uint32_t LevenshteinAutomaton::addState( const uint8_t *row )
+  {
+    auto res = pStates.emplace( std::string( (const char *)row, pWidth ),
+                                pStates.size() );
+    if( res.second )
+    {
+      pRows.insert( pRows.end(), row, row+pWidth );
+      pTransitions.resize( pTransitions.size()+256, Unknown );
+    }
+    return res.first->second;
+  }
+}
@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Deterministic automaton accepting the strings within a given edit
+  //! distance from a term
+  //!
+  //! A state is a row of the Levenshtein matrix of the term against the
+  //! input read so far, with the distances capped at maxDistance+1. Equal
+  //! rows are the same state, so the states and their transitions are
+  //! built lazily as the input needs them and the dictionary walks that
+  //! feed a lot of strings sharing prefixes mostly hit the cache. A row
+  //! with all the distances over the limit is the dead state: no
+  //! continuation of the input can be accepted anymore.
+  //----------------------------------------------------------------------------
+  class LevenshteinAutomaton
+  {
+    public:
+      static const uint32_t MaxDistance = 2;
+      static const uint32_t Dead        = 0;
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param term        the term to match
+      //! @param maxDistance the largest accepted edit distance, at most
+      //!                    MaxDistance
+      //------------------------------------------------------------------------
+      LevenshteinAutomaton( std::string_view term, uint32_t maxDistance );
+
+      //------------------------------------------------------------------------
+      //! The state before reading any input
+      //------------------------------------------------------------------------
+      uint32_t start() const
+      {
+        return pStart;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the state after reading a character in the given state
+      //------------------------------------------------------------------------
+      uint32_t step( uint32_t state, char ch )
+      {
+        size_t   transition = state*256 + (uint8_t)ch;
+        uint32_t next       = pTransitions[transition];
+        if( next == Unknown )
+        {
+          next = computeStep( state, ch );
+          pTransitions[transition] = next;
+        }
+        return next;
+      }
+
+      //------------------------------------------------------------------------
+      //! Feed a whole string starting in the given state
+      //------------------------------------------------------------------------
+      uint32_t run( uint32_t state, std::string_view input )
+      {
+        for( size_t i = 0; i < input.size() && state != Dead; ++i )
+          state = step( state, input[i] );
+        return state;
+      }
+
+      //------------------------------------------------------------------------
+      //! Is the input read so far within the distance
+      //------------------------------------------------------------------------
+      bool isMatch( uint32_t state ) const
+      {
+        return pRows[state*pWidth + pWidth-1] <= pMaxDistance;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of the states built so far
+      //------------------------------------------------------------------------
+      size_t numStates() const
+      {
+        return pRows.size() / pWidth;
+      }
+
+    private:
+      static const uint32_t Unknown = (uint32_t)-1;
+
+      uint32_t computeStep( uint32_t state, char ch );
+      uint32_t addState( const uint8_t *row );
+
+      std::string                               pTerm;
+      uint8_t                                   pMaxDistance;
+      size_t                                    pWidth;
+      uint32_t                                  pStart = Dead;
+      std::vector<uint8_t>                      pRows;
+      std::vector<uint8_t>                      pNext;
+      std::vector<uint32_t>                     pTransitions;
+      std::unordered_map<std::string, uint32_t> pStates;
+  };
+}
@@ -0,0 +1,211 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Librarian/MappedIndex.hh>
+#include <Librarian/DocumentTable.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Destructor
+  //----------------------------------------------------------------------------
+  MappedIndex::~MappedIndex()
+  {
+    close();
+  }
+
+  //----------------------------------------------------------------------------
+  // Map an index file
+  //----------------------------------------------------------------------------
+  Status MappedIndex::open( const std::string &filename, bool verify )
+  {
+    close();
+
+    int fd = ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 )
+      return Status( Status::errIO, strerror( errno ) );
+
+    struct stat st;
+    if( fstat( fd, &st ) )
+    {
+      Status status( Status::errIO, strerror( errno ) );
+      ::close( fd );
+      return status;
+    }
+
+    if( (size_t)st.st_size < sizeof(IndexFile::Header) )
+    {
+      ::close( fd );
+      return Status( Status::errIO, "Not a binary index file" );
+    }
+
+    void *data = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if( data == MAP_FAILED )
+      return Status( Status::errIO, strerror( errno ) );
+
+    pData = data;
+    pSize = st.st_size;
+    ++pVersion;
+    Status status = pFile.open( pData, pSize, verify );
+    if( !status.isOK() )
+      close();
+    return status;
+  }
+
+  //----------------------------------------------------------------------------
+  // Unmap the file
+  //----------------------------------------------------------------------------
+  void MappedIndex::close()
+  {
+    if( pData )
+      munmap( pData, pSize );
+    pData = 0;
+    pSize = 0;
+    ++pVersion;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the postings of a term
+  //----------------------------------------------------------------------------
+  bool MappedIndex::findTerm( std::string_view  term,
+                              TermPostings     &postings ) const
+  {
+    IndexFile::TermEntry entry;
+    if( !pFile.findTerm( term, entry ) )
+      return false;
+    postings.clear();
+    postings.add( getPostings( entry ) );
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms starting with the prefix
+  //----------------------------------------------------------------------------
+  void MappedIndex::visitTerms( std::string_view   prefix,
+                                const TermVisitor &visitor ) const
+  {
+    auto it = pFile.getDictionary().lowerBound( prefix );
+    for( ; it.valid() && it.term().starts_with( prefix ); it.next() )
+    {
+      if( !pFile.isValid( it.entry() ) )
+        continue;
+      if( !visitor( it.term(), TermPostings( getPostings( it.entry() ) ) ) )
+        return;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms within the edit distance from the term
+  //----------------------------------------------------------------------------
+  void MappedIndex::visitSimilarTerms( std::string_view   term,
+                                       uint32_t           maxDistance,
+                                       const TermVisitor &visitor ) const
+  {
+    LevenshteinAutomaton automaton( term, maxDistance );
+    visitAcceptedTerms( automaton, visitor );
+  }
+
+  //----------------------------------------------------------------------------
+  // Intersect the automaton with the dictionary: the states reached by all
+  // the prefixes of the current term are kept, so only the suffix that
+  // differs from the previous term needs to be run; when a prefix kills
+  // the automaton, no term starting with it can match and the iterator
+  // seeks past all of them
+  //----------------------------------------------------------------------------
+  void MappedIndex::visitAcceptedTerms( LevenshteinAutomaton &automaton,
+                                        const TermVisitor    &visitor ) const
+  {
+    const TermDictionary  &dictionary = pFile.getDictionary();
+    std::vector<uint32_t>  states( 1, automaton.start() );
+    std::string            previous;
+    std::string            next;
+
+    auto it = dictionary.begin();
+    while( it.valid() )
+    {
+      std::string_view current = it.term();
+      size_t common = std::min( { current.size(), previous.size(),
+                                  states.size()-1 } );
+      common = std::mismatch( current.begin(), current.begin()+common,
+                              previous.begin() ).first - current.begin();
+      states.resize( common+1 );
+      while( states.size() <= current.size() &&
+             states.back() != LevenshteinAutomaton::Dead )
+        states.push_back( automaton.step( states.back(),
+                                          current[states.size()-1] ) );
+      previous.assign( current );
+
+      if( states.back() != LevenshteinAutomaton::Dead )
+      {
+        if( automaton.isMatch( states.back() ) &&
+            pFile.isValid( it.entry() ) &&
+            !visitor( current, TermPostings( getPostings( it.entry() ) ) ) )
+          return;
+        it.next();
+        continue;
+      }
+
+      //------------------------------------------------------------------------
+      // Seek to the first term larger than all the ones with the dead
+      // prefix
+      //------------------------------------------------------------------------
+      next.assign( current.substr( 0, states.size()-1 ) );
+      while( !next.empty() && (uint8_t)next.back() == 0xff )
+        next.pop_back();
+      if( next.empty() )
+        return;
+      next.back() = (char)((uint8_t)next.back()+1);
+      it.seek( next );
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Get the first document with an id larger than the given one
+  //----------------------------------------------------------------------------
+  docid_t MappedIndex::nextDocument( docid_t id ) const
+  {
+    docid_t end = pFile.getHeader().freeDocId;
+    if( id >= end )
+      return 0;
+    for( id = std::max( id+1, pFile.getHeader().firstDocId ); id < end; ++id )
+      if( !pFile.getDocumentName( id ).empty() )
+        return id;
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the bits of all the documents in use
+  //----------------------------------------------------------------------------
+  void MappedIndex::fillDocuments( Bitmap &bitmap ) const
+  {
+    const IndexFile::Header &header = pFile.getHeader();
+    DocumentTable::fill( bitmap, header.firstDocId, pFile.getDocumentOffsets(),
+                         header.freeDocId - header.firstDocId,
+                         header.numDocuments );
+  }
+}
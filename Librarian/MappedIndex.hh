@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+#include <Librarian/Status.hh>
+#include <Librarian/IndexReader.hh>
+#include <Librarian/IndexFile.hh>
+#include <Librarian/LevenshteinAutomaton.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Read-only index served straight from a memory-mapped index file;
+  //! nothing is deserialized, so opening it is cheap and all the processes
+  //! using the same file share one copy of it in the page cache
+  //----------------------------------------------------------------------------
+  class MappedIndex: public IndexReader
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      MappedIndex() {}
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~MappedIndex();
+
+      MappedIndex( const MappedIndex & ) = delete;
+      MappedIndex &operator = ( const MappedIndex & ) = delete;
+
+      //------------------------------------------------------------------------
+      //! Map an index file
+      //!
+      //! @param verify check the checksums and all the table entries, this
+      //!               reads the whole file; otherwise the postings are
+      //!               only checked block by block as the queries read
+      //!               them, and the corrupted blocks are skipped
+      //------------------------------------------------------------------------
+      Status open( const std::string &filename, bool verify = false );
+
+      //------------------------------------------------------------------------
+      //! Unmap the file
+      //------------------------------------------------------------------------
+      void close();
+
+      //------------------------------------------------------------------------
+      //! Find the postings of a term
+      //------------------------------------------------------------------------
+      virtual bool findTerm( std::string_view  term,
+                             TermPostings     &postings ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms starting with the prefix
+      //------------------------------------------------------------------------
+      virtual void visitTerms( std::string_view   prefix,
+                               const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms within the edit distance from the term
+      //------------------------------------------------------------------------
+      virtual void visitSimilarTerms( std::string_view   term,
+                                      uint32_t           maxDistance,
+                                      const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms accepted by the automaton in lexicographical
+      //! order, the automaton may be shared by many indices
+      //------------------------------------------------------------------------
+      void visitAcceptedTerms( LevenshteinAutomaton &automaton,
+                               const TermVisitor    &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Get document name for the given id
+      //------------------------------------------------------------------------
+      virtual std::string_view getDocumentName( docid_t id ) const
+      {
+        return pFile.getDocumentName( id );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the first document with an id larger than the given one
+      //------------------------------------------------------------------------
+      virtual docid_t nextDocument( docid_t id ) const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents in use
+      //------------------------------------------------------------------------
+      virtual void fillDocuments( Bitmap &bitmap ) const;
+
+      //------------------------------------------------------------------------
+      //! Get number of documents
+      //------------------------------------------------------------------------
+      virtual docid_t numDocuments() const
+      {
+        return pFile.getHeader().numDocuments;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the largest document id in use
+      //------------------------------------------------------------------------
+      virtual docid_t maxDocId() const
+      {
+        return pFile.getHeader().freeDocId-1;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the version of the contents, it changes when a file is mapped
+      //! or unmapped
+      //------------------------------------------------------------------------
+      virtual uint64_t getVersion() const
+      {
+        return pVersion;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the underlying index file
+      //------------------------------------------------------------------------
+      const IndexFile &getFile() const
+      {
+        return pFile;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the postings a dictionary entry points to, the entry needs to
+      //! be valid
+      //------------------------------------------------------------------------
+      PostingsView getPostings( const IndexFile::TermEntry &entry ) const
+      {
+        return PostingsView( pFile.getBlockHeaders( entry ), entry.numBlocks,
+                             pFile.getBlockData( entry ), entry.dataLength,
+                             0, 0, entry.numPostings );
+      }
+
+    private:
+      void      *pData    = 0;
+      size_t     pSize    = 0;
+      uint64_t   pVersion = 0;
+      IndexFile  pFile;
+  };
+}
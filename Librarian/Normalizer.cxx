@@ -17,10 +17,8 @@
 // along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
 //------------------------------------------------------------------------------
 
-#include <cctype>
-#include <algorithm>
-
 #include <Librarian/Normalizer.hh>
+#include <Librarian/TextKernels.hh>
 
 namespace Librarian
 {
@@ -29,22 +27,22 @@ namespace Librarian
   //----------------------------------------------------------------------------
   std::string LatinNormalizer::removePunctuation( const std::string &str )
   {
-    int s = 0, e = 0;
-    for( ; s < str.length() && !isalnum(str[s]); ++s );
-    for( ; s+e < str.length() && isalnum(str[s+e]); ++e );
-    return str.substr( s, e );
+    const char *end;
+    const char *start = TextKernels::alnumRun( str.data(), str.data()+str.size(),
+                                               &end );
+    return std::string( start, end );
   }
 
   //----------------------------------------------------------------------------
   // Normalize the input string by returning the base form of the string
   //----------------------------------------------------------------------------
-  std::string EnglishNormalizer::normalize( const std::string &str )
+  std::string_view EnglishNormalizer::normalize( std::string_view  str,
+                                                 std::string      &buffer )
   {
-    std::string out; out.reserve( str.size() );
-    int s = 0, e = 0;
-    for( ; s < str.length() && !isalnum(str[s]); ++s );
-    for( ; s+e < str.length() && isalnum(str[s+e]); ++e )
-      out += tolower(str[s+e]);
-    return out;
+    if( buffer.size() < str.size() )
+      buffer.resize( str.size() );
+    size_t length = TextKernels::normalize( &buffer[0], str.data(),
+                                            str.data()+str.size() );
+    return std::string_view( buffer.data(), length );
   }
 }
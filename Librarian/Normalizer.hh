@@ -20,6 +20,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <Librarian/Status.hh>
@@ -37,10 +38,32 @@ namespace Librarian
       //------------------------------------------------------------------------
       virtual std::string removePunctuation( const std::string &str ) = 0;
 
+      //------------------------------------------------------------------------
+      //! Normalize the input string without allocating memory in the common
+      //! case
+      //!
+      //! @param str    the input
+      //! @param buffer storage the result may be written to, reusing it
+      //!               avoids allocations
+      //! @return       the base form of the input, valid until the buffer
+      //!               or the input change
+      //------------------------------------------------------------------------
+      virtual std::string_view normalize( std::string_view  str,
+                                          std::string      &buffer ) = 0;
+
       //------------------------------------------------------------------------
       //! Normalize the input string by returning the base form of the string
       //------------------------------------------------------------------------
-      virtual std::string normalize( const std::string &str ) = 0;
+      std::string normalize( const std::string &str )
+      {
+        std::string buffer;
+        return std::string( normalize( str, buffer ) );
+      }
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~Normalizer() {}
   };
 
   //----------------------------------------------------------------------------
@@ -61,9 +84,13 @@ namespace Librarian
   class EnglishNormalizer: public LatinNormalizer
   {
     public:
+      using Normalizer::normalize;
+
       //------------------------------------------------------------------------
-      //! Normalize the input string by returning the base form of the string
+      //! Normalize the input string, lowercase the first run of letters and
+      //! digits
       //------------------------------------------------------------------------
-      virtual std::string normalize( const std::string &str );
+      virtual std::string_view normalize( std::string_view  str,
+                                          std::string      &buffer );
   };
 }
@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cstring>
+
+#include <Librarian/PostingCodec.hh>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBRARIAN_X86 1
+#endif
+
+namespace
+{
+  using Librarian::docid_t;
+
+  //----------------------------------------------------------------------------
+  // Byte length of a gap
+  //----------------------------------------------------------------------------
+  inline uint32_t gapLength( uint32_t gap )
+  {
+    if( gap < (1u << 8) )  return 1;
+    if( gap < (1u << 16) ) return 2;
+    if( gap < (1u << 24) ) return 3;
+    return 4;
+  }
+
+  //----------------------------------------------------------------------------
+  // Lookup tables indexed by a control byte: the number of data bytes used
+  // by the four gaps and the shuffle mask expanding them to 32 bits each
+  //----------------------------------------------------------------------------
+  struct Tables
+  {
+    Tables()
+    {
+      for( int c = 0; c < 256; ++c )
+      {
+        uint8_t pos = 0;
+        for( int i = 0; i < 4; ++i )
+        {
+          uint8_t len = ((c >> (2*i)) & 0x03) + 1;
+          for( int b = 0; b < 4; ++b )
+            shuffle[c][4*i+b] = b < len ? pos+b : 0x80;
+          pos += len;
+        }
+        length[c] = pos;
+      }
+    }
+    uint8_t length[256];
+    alignas(16) uint8_t shuffle[256][16];
+  };
+  const Tables gTables;
+
+  //----------------------------------------------------------------------------
+  // Decode the gaps and turn them into offsets from the first id, scalar
+  //----------------------------------------------------------------------------
+  void decodeOffsetsScalar( uint32_t      *out,
+                            const uint8_t *ctrl,
+                            const uint8_t *data,
+                            const uint8_t *,
+                            uint32_t       num )
+  {
+    uint32_t acc = 0;
+    for( uint32_t i = 0; i < num; ++i )
+    {
+      uint32_t len = ((ctrl[i/4] >> (2*(i%4))) & 0x03) + 1;
+      uint32_t gap = 0;
+      memcpy( &gap, data, len );
+      data += len;
+      acc += gap;
+      out[i] = acc;
+    }
+  }
+
+#ifdef LIBRARIAN_X86
+  //----------------------------------------------------------------------------
+  // Decode the gaps and turn them into offsets from the first id, four at
+  // a time with SSSE3 byte shuffles; the prefix sum is done in registers
+  //----------------------------------------------------------------------------
+  __attribute__((target("ssse3")))
+  void decodeOffsetsSSSE3( uint32_t      *out,
+                           const uint8_t *ctrl,
+                           const uint8_t *data,
+                           const uint8_t *end,
+                           uint32_t       num )
+  {
+    __m128i  carry = _mm_setzero_si128();
+    uint32_t i     = 0;
+
+    //--------------------------------------------------------------------------
+    // Full groups for which a 16-byte load does not cross the end of the
+    // encoded block
+    //--------------------------------------------------------------------------
+    for( ; i+4 <= num && data+16 <= end; i += 4 )
+    {
+      uint8_t c = ctrl[i/4];
+      __m128i v = _mm_loadu_si128( (const __m128i*)data );
+      v = _mm_shuffle_epi8( v, *(const __m128i*)gTables.shuffle[c] );
+      data += gTables.length[c];
+      v = _mm_add_epi32( v, _mm_slli_si128( v, 4 ) );
+      v = _mm_add_epi32( v, _mm_slli_si128( v, 8 ) );
+      v = _mm_add_epi32( v, carry );
+      _mm_storeu_si128( (__m128i*)(out+i), v );
+      carry = _mm_shuffle_epi32( v, 0xff );
+    }
+
+    if( i == num )
+      return;
+
+    //--------------------------------------------------------------------------
+    // The tail
+    //--------------------------------------------------------------------------
+    uint32_t acc = _mm_cvtsi128_si32( carry );
+    for( ; i < num; ++i )
+    {
+      uint32_t len = ((ctrl[i/4] >> (2*(i%4))) & 0x03) + 1;
+      uint32_t gap = 0;
+      memcpy( &gap, data, len );
+      data += len;
+      acc += gap;
+      out[i] = acc;
+    }
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  // Pick the decoder for the CPU we run on
+  //----------------------------------------------------------------------------
+  typedef void (*DecodeFn)( uint32_t*, const uint8_t*, const uint8_t*,
+                            const uint8_t*, uint32_t );
+
+  struct Decoder
+  {
+    Decoder()
+    {
+#ifdef LIBRARIAN_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "ssse3" ) )
+      {
+        function = decodeOffsetsSSSE3;
+        name     = "ssse3";
+      }
+#endif
+    }
+    DecodeFn    function = decodeOffsetsScalar;
+    const char *name     = "scalar";
+  };
+  const Decoder gDecoder;
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Append an encoded block
+  //----------------------------------------------------------------------------
+  uint32_t PostingCodec::encode( std::vector<uint8_t> &out,
+                                 const docid_t        *ids,
+                                 uint32_t              num )
+  {
+    if( num < 2 )
+      return 0;
+
+    uint32_t numGaps  = num-1;
+    uint32_t ctrlSize = (numGaps+3)/4;
+    size_t   start    = out.size();
+    out.resize( start + ctrlSize + 4*numGaps );
+
+    uint8_t *ctrl = out.data() + start;
+    uint8_t *data = ctrl + ctrlSize;
+    memset( ctrl, 0, ctrlSize );
+    for( uint32_t i = 0; i < numGaps; ++i )
+    {
+      uint32_t gap = ids[i+1] - ids[i];
+      uint32_t len = gapLength( gap );
+      ctrl[i/4] |= (len-1) << (2*(i%4));
+      memcpy( data, &gap, len );
+      data += len;
+    }
+    out.resize( data - out.data() );
+    return out.size() - start;
+  }
+
+  //----------------------------------------------------------------------------
+  // Decode a block
+  //----------------------------------------------------------------------------
+  void PostingCodec::decode( docid_t       *out,
+                             const uint8_t *in,
+                             uint32_t       length,
+                             docid_t        first,
+                             uint32_t       num )
+  {
+    out[0] = first;
+    if( num < 2 )
+      return;
+
+    uint32_t numGaps = num-1;
+    uint32_t ctrlSize = (numGaps+3)/4;
+    uint32_t offsets[MaxBlockSize];
+    gDecoder.function( offsets, in, in+ctrlSize, in+length, numGaps );
+    for( uint32_t i = 0; i < numGaps; ++i )
+      out[i+1] = first + offsets[i];
+  }
+
+  //----------------------------------------------------------------------------
+  // Check the length of an encoded block, the full control bytes are
+  // summed up through the table and the last one gap by gap
+  //----------------------------------------------------------------------------
+  bool PostingCodec::isValid( const uint8_t *in, uint32_t length, uint32_t num )
+  {
+    if( num < 2 )
+      return true;
+
+    uint32_t numGaps  = num-1;
+    uint32_t ctrlSize = (numGaps+3)/4;
+    if( ctrlSize > length )
+      return false;
+
+    uint64_t total = ctrlSize;
+    for( uint32_t i = 0; i < numGaps/4; ++i )
+      total += gTables.length[in[i]];
+    for( uint32_t i = numGaps/4*4; i < numGaps; ++i )
+      total += ((in[i/4] >> (2*(i%4))) & 0x03) + 1;
+    return total <= length;
+  }
+
+  //----------------------------------------------------------------------------
+  // Name of the decoder
+  //----------------------------------------------------------------------------
+  const char *PostingCodec::decoderName()
+  {
+    return gDecoder.name;
+  }
+}
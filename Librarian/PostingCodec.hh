@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Librarian
+{
+  typedef uint64_t docid_t;
+
+  //----------------------------------------------------------------------------
+  //! Compress blocks of sorted document ids
+  //!
+  //! The first id of a block is kept by the caller (in the block header),
+  //! the remaining ones are stored as gaps to their predecessors using the
+  //! StreamVByte layout: a 2-bit length code per gap packed four to a
+  //! control byte, followed by the gaps themselves in 1 to 4 bytes each.
+  //! The gaps of four ids can then be expanded with a single byte shuffle.
+  //! All ids of a block must lie within 2^32 of the first one.
+  //----------------------------------------------------------------------------
+  class PostingCodec
+  {
+    public:
+      static const uint32_t MaxBlockSize = 128;
+
+      //------------------------------------------------------------------------
+      //! Check whether the id can join a block starting at first
+      //------------------------------------------------------------------------
+      static bool fits( docid_t first, docid_t id )
+      {
+        return id - first <= 0xffffffff;
+      }
+
+      //------------------------------------------------------------------------
+      //! Append an encoded block of num ids to out
+      //!
+      //! @return number of bytes appended
+      //------------------------------------------------------------------------
+      static uint32_t encode( std::vector<uint8_t> &out,
+                              const docid_t        *ids,
+                              uint32_t              num );
+
+      //------------------------------------------------------------------------
+      //! Decode a block of num ids
+      //!
+      //! @param out    output buffer, at least num entries long
+      //! @param in     encoded data
+      //! @param length length of the encoded data
+      //! @param first  first id of the block
+      //! @param num    number of ids in the block
+      //------------------------------------------------------------------------
+      static void decode( docid_t       *out,
+                          const uint8_t *in,
+                          uint32_t       length,
+                          docid_t        first,
+                          uint32_t       num );
+
+      //------------------------------------------------------------------------
+      //! Check that the control bytes of an encoded block of num ids only
+      //! describe data within the given length, so that decoding it does
+      //! not read past the block
+      //------------------------------------------------------------------------
+      static bool isValid( const uint8_t *in, uint32_t length, uint32_t num );
+
+      //------------------------------------------------------------------------
+      //! Name of the decoder selected for this CPU
+      //------------------------------------------------------------------------
+      static const char *decoderName();
+  };
+}
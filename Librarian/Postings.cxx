@@ -0,0 +1,929 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+
+#include <Librarian/Postings.hh>
+#include <Librarian/Bitmap.hh>
+
+using namespace Librarian;
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Id ranges of the blocks of all the parts, the tails included
+  //----------------------------------------------------------------------------
+  struct Range
+  {
+    docid_t  min;
+    docid_t  max;
+    uint64_t count;
+  };
+
+  void getRanges( const TermPostings &postings, std::vector<Range> &ranges )
+  {
+    for( size_t p = 0; p < postings.numParts(); ++p )
+    {
+      const PostingsView &part = postings.getPart( p );
+      for( size_t i = 0; i < part.numBlocks(); ++i )
+      {
+        const PostingList::BlockHeader &h = part.getBlockHeader( i );
+        ranges.push_back( Range{ h.min, h.max, h.count } );
+      }
+      if( part.tailSize() )
+        ranges.push_back( Range{ part.getTail()[0],
+                                 part.getTail()[part.tailSize()-1],
+                                 part.tailSize() } );
+    }
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Find the first block that may contain the id
+  //----------------------------------------------------------------------------
+  size_t PostingsView::findBlock( docid_t id ) const
+  {
+    auto it = std::lower_bound( pHeaders, pHeaders+pNumBlocks, id,
+                                []( const BlockHeader &h, docid_t id )
+                                  { return h.max < id; } );
+    return it - pHeaders;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the first block at or after the given one that may contain the id
+  //----------------------------------------------------------------------------
+  size_t PostingsView::findBlock( docid_t id, size_t from ) const
+  {
+    size_t lo = from, probe = from, step = 1;
+    while( probe < pNumBlocks && pHeaders[probe].max < id )
+    {
+      lo     = probe+1;
+      probe += step;
+      step  *= 2;
+    }
+    auto it = std::lower_bound( pHeaders+lo,
+                                pHeaders+std::min( probe, pNumBlocks ), id,
+                                []( const BlockHeader &h, docid_t id )
+                                  { return h.max < id; } );
+    return it - pHeaders;
+  }
+
+  //----------------------------------------------------------------------------
+  // Check the header of a block against the data of the view
+  //----------------------------------------------------------------------------
+  bool PostingsView::isValid( size_t block ) const
+  {
+    const BlockHeader &h = pHeaders[block];
+    if( h.min > h.max || h.offset > pDataLength ||
+        h.length > pDataLength - h.offset )
+      return false;
+
+    switch( h.type )
+    {
+      case PostingList::PackedBlock:
+        return h.count != 0 && h.count <= PostingList::BlockSize &&
+          PostingCodec::isValid( pData+h.offset, h.length, h.count );
+
+      case PostingList::BitmapBlock:
+        return h.max - PostingList::chunkBase( h.min ) <
+          PostingList::ChunkSize &&
+          h.length >= PostingList::BitmapWords*8;
+
+      case PostingList::RunBlock:
+        return h.max - PostingList::chunkBase( h.min ) <
+          PostingList::ChunkSize && h.length % 4 == 0;
+    }
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  // Append all the ids of a block to the vector
+  //----------------------------------------------------------------------------
+  void PostingsView::decode( size_t block, std::vector<docid_t> &out ) const
+  {
+    if( !isValid( block ) )
+      return;
+
+    const BlockHeader &h    = pHeaders[block];
+    const uint8_t     *data = getBlockData( block );
+    docid_t            base = PostingList::chunkBase( h.min );
+    size_t             size = out.size();
+
+    switch( h.type )
+    {
+      case PostingList::PackedBlock:
+        out.resize( size + h.count );
+        decodeBlock( block, out.data() + size );
+        break;
+
+      case PostingList::BitmapBlock:
+        for( uint32_t i = 0; i < PostingList::BitmapWords; ++i )
+        {
+          uint64_t word;
+          memcpy( &word, data + 8*i, 8 );
+          for( ; word; word &= word-1 )
+            out.push_back( base + 64*i + __builtin_ctzll( word ) );
+        }
+        break;
+
+      case PostingList::RunBlock:
+        for( uint32_t i = 0; i < h.length; i += 4 )
+        {
+          uint16_t start, length;
+          memcpy( &start,  data+i,   2 );
+          memcpy( &length, data+i+2, 2 );
+          for( uint32_t k = 0; k <= length; ++k )
+            out.push_back( base + start + k );
+        }
+        break;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Number of postings held in bitmap and run blocks
+  //----------------------------------------------------------------------------
+  uint64_t PostingsView::denseCount() const
+  {
+    uint64_t count = 0;
+    for( size_t i = 0; i < pNumBlocks; ++i )
+      if( pHeaders[i].type != PostingList::PackedBlock )
+        count += pHeaders[i].count;
+    return count;
+  }
+
+  //----------------------------------------------------------------------------
+  // Gather the statistics from the block headers
+  //----------------------------------------------------------------------------
+  PostingStatistics PostingsView::getStatistics() const
+  {
+    PostingStatistics stats;
+    stats.documents = pCount;
+    stats.blocks    = pNumBlocks + (pTailSize != 0);
+    stats.bytes     = pTailSize*sizeof(docid_t);
+    for( size_t i = 0; i < pNumBlocks; ++i )
+    {
+      stats.bytes += pHeaders[i].length;
+      if( pHeaders[i].type != PostingList::PackedBlock )
+      {
+        stats.dense      += pHeaders[i].count;
+        stats.denseBytes += pHeaders[i].length;
+      }
+    }
+    return stats;
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the bits of all the postings in the bitmap
+  //----------------------------------------------------------------------------
+  void PostingsView::fill( Bitmap &bitmap ) const
+  {
+    docid_t buffer[PostingList::BlockSize];
+    for( size_t i = 0; i < pNumBlocks; ++i )
+    {
+      if( !isValid( i ) )
+        continue;
+
+      const BlockHeader &h    = pHeaders[i];
+      const uint8_t     *data = getBlockData( i );
+      docid_t            base = PostingList::chunkBase( h.min );
+
+      switch( h.type )
+      {
+        case PostingList::PackedBlock:
+          decodeBlock( i, buffer );
+          for( uint32_t k = 0; k < h.count; ++k )
+            if( buffer[k] < bitmap.size() )
+              bitmap.set( buffer[k] );
+          break;
+
+        case PostingList::BitmapBlock:
+          bitmap.orWords( base/64, data, PostingList::BitmapWords );
+          break;
+
+        case PostingList::RunBlock:
+          for( uint32_t k = 0; k < h.length; k += 4 )
+          {
+            uint16_t start, length;
+            memcpy( &start,  data+k,   2 );
+            memcpy( &length, data+k+2, 2 );
+            bitmap.setRange( base+start, base+start+length+1 );
+          }
+          break;
+      }
+    }
+
+    for( size_t i = 0; i < pTailSize; ++i )
+      if( pTail[i] < bitmap.size() )
+        bitmap.set( pTail[i] );
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the first block that may contain the id
+  //----------------------------------------------------------------------------
+  size_t PostingList::findBlock( docid_t id ) const
+  {
+    return view().findBlock( id );
+  }
+
+  //----------------------------------------------------------------------------
+  // Append all the ids of a block to the vector
+  //----------------------------------------------------------------------------
+  void PostingList::decode( size_t block, std::vector<docid_t> &out ) const
+  {
+    view().decode( block, out );
+  }
+
+  //----------------------------------------------------------------------------
+  // Number of postings held in bitmap and run blocks
+  //----------------------------------------------------------------------------
+  uint64_t PostingList::denseCount() const
+  {
+    return view().denseCount();
+  }
+
+  //----------------------------------------------------------------------------
+  // Set the bits of all the postings in the bitmap
+  //----------------------------------------------------------------------------
+  void PostingList::fill( Bitmap &bitmap ) const
+  {
+    view().fill( bitmap );
+  }
+
+  //----------------------------------------------------------------------------
+  // Compress the tail block
+  //----------------------------------------------------------------------------
+  void PostingList::flushTail()
+  {
+    appendBlocks( pHeaders, pData, pTail.data(), pTail.size(), BlockSize );
+    pTail.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  // Pick the containers for the last chunk and compress the tail
+  //----------------------------------------------------------------------------
+  void PostingList::seal()
+  {
+    if( pCount == 0 )
+      return;
+    docid_t last = pTail.empty() ? pHeaders.back().max : pTail.back();
+    compactChunk( chunkBase( last ) );
+    flushTail();
+    pHeaders.shrink_to_fit();
+    pData.shrink_to_fit();
+    pTail.shrink_to_fit();
+  }
+
+  //----------------------------------------------------------------------------
+  // Replace the contents of the list with already encoded blocks
+  //----------------------------------------------------------------------------
+  bool PostingList::assign( const BlockHeader *headers,
+                            size_t             numBlocks,
+                            const uint8_t     *data,
+                            size_t             length )
+  {
+    uint64_t count = 0;
+    for( size_t i = 0; i < numBlocks; ++i )
+    {
+      const BlockHeader &h = headers[i];
+      if( h.offset > length || h.length > length - h.offset ||
+          h.min > h.max || h.count == 0 ||
+          (i > 0 && headers[i-1].max >= h.min) )
+        return false;
+
+      switch( h.type )
+      {
+        case PackedBlock:
+          if( h.count > BlockSize || !PostingCodec::fits( h.min, h.max ) )
+            return false;
+          break;
+        case BitmapBlock:
+          if( h.length != 8*BitmapWords )
+            return false;
+          break;
+        case RunBlock:
+          if( h.length % 4 )
+            return false;
+          break;
+        default:
+          return false;
+      }
+      if( h.type != PackedBlock && chunkBase( h.min ) != chunkBase( h.max ) )
+        return false;
+      count += h.count;
+    }
+
+    pHeaders.assign( headers, headers+numBlocks );
+    pData.assign( data, data+length );
+    pTail.clear();
+    pCount = count;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Add a posting that does not fit the tail
+  //----------------------------------------------------------------------------
+  bool PostingList::addSlow( docid_t id )
+  {
+    if( pCount == 0 )
+    {
+      pTail.push_back( id );
+      ++pCount;
+      return true;
+    }
+
+    docid_t last = pTail.empty() ? pHeaders.back().max : pTail.back();
+    if( id <= last )
+      return insert( id );
+
+    //--------------------------------------------------------------------------
+    // Moving on to a new chunk, pick the containers for the previous one
+    //--------------------------------------------------------------------------
+    if( chunkBase( id ) != chunkBase( last ) )
+      compactChunk( chunkBase( last ) );
+
+    if( pTail.size() == BlockSize ||
+        (!pTail.empty() && !PostingCodec::fits( pTail[0], id )) )
+      flushTail();
+    pTail.push_back( id );
+    ++pCount;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Re-encode the postings of the last chunk with the best container
+  //----------------------------------------------------------------------------
+  void PostingList::compactChunk( docid_t base )
+  {
+    auto first = std::lower_bound( pHeaders.begin(), pHeaders.end(), base,
+                                   []( const BlockHeader &h, docid_t id )
+                                     { return h.min < id; } );
+    auto split = std::lower_bound( pTail.begin(), pTail.end(), base );
+
+    uint64_t count = pTail.end() - split;
+    for( auto it = first; it != pHeaders.end(); ++it )
+      count += it->count;
+    if( count < BlockSize )
+      return;
+
+    //--------------------------------------------------------------------------
+    // The postings of the previous chunks that are still in the tail are
+    // packed on their own; if there are any, then no block can belong to
+    // this chunk
+    //--------------------------------------------------------------------------
+    size_t firstBlock = first - pHeaders.begin();
+    if( split != pTail.begin() )
+    {
+      appendBlocks( pHeaders, pData, pTail.data(), split - pTail.begin(),
+                    BlockSize );
+      firstBlock = pHeaders.size();
+    }
+
+    std::vector<docid_t> ids;
+    ids.reserve( count );
+    for( size_t i = firstBlock; i < pHeaders.size(); ++i )
+      decode( i, ids );
+    ids.insert( ids.end(), split, pTail.end() );
+    pTail.clear();
+
+    if( firstBlock < pHeaders.size() )
+    {
+      pData.resize( pHeaders[firstBlock].offset );
+      pHeaders.resize( firstBlock );
+    }
+    appendContainer( pHeaders, pData, ids.data(), ids.size() );
+  }
+
+  //----------------------------------------------------------------------------
+  // Insert a posting that does not go to the end of the list
+  //----------------------------------------------------------------------------
+  bool PostingList::insert( docid_t id )
+  {
+    size_t block = findBlock( id );
+
+    //--------------------------------------------------------------------------
+    // The posting belongs to the tail
+    //--------------------------------------------------------------------------
+    if( block == pHeaders.size() )
+    {
+      auto it = std::lower_bound( pTail.begin(), pTail.end(), id );
+      if( it != pTail.end() && *it == id )
+        return false;
+      pTail.insert( it, id );
+      ++pCount;
+      if( pTail.size() > BlockSize || !PostingCodec::fits( pTail[0],
+                                                          pTail.back() ) )
+        flushTail();
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Bitmaps and runs only hold the postings of their own chunk, anything
+    // preceding it goes to the previous packed block or to a new one
+    //--------------------------------------------------------------------------
+    if( pHeaders[block].type != PackedBlock &&
+        chunkBase( id ) != chunkBase( pHeaders[block].min ) )
+    {
+      if( block > 0 && pHeaders[block-1].type == PackedBlock )
+        --block;
+      else
+      {
+        BlockHeader h = { id, id, pHeaders[block].offset, 1, 0, PackedBlock,
+                          0 };
+        pHeaders.insert( pHeaders.begin()+block, h );
+        ++pCount;
+        return true;
+      }
+    }
+
+    //--------------------------------------------------------------------------
+    // Bitmaps can be updated in place
+    //--------------------------------------------------------------------------
+    BlockHeader &h = pHeaders[block];
+    if( h.type == BitmapBlock )
+    {
+      uint8_t  *bits = pData.data() + h.offset;
+      uint64_t  bit  = id - chunkBase( h.min );
+      if( bits[bit/8] & (1 << (bit%8)) )
+        return false;
+      bits[bit/8] |= 1 << (bit%8);
+      h.min = std::min( h.min, id );
+      ++h.count;
+      ++pCount;
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Decode the block and re-encode it with the new posting, this may
+    // split it in two
+    //--------------------------------------------------------------------------
+    std::vector<docid_t> ids;
+    decode( block, ids );
+    auto it = std::lower_bound( ids.begin(), ids.end(), id );
+    if( it != ids.end() && *it == id )
+      return false;
+    ids.insert( it, id );
+    replaceBlock( block, ids );
+    ++pCount;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Remove a posting
+  //----------------------------------------------------------------------------
+  bool PostingList::remove( docid_t id )
+  {
+    size_t block = findBlock( id );
+    if( block == pHeaders.size() )
+    {
+      auto it = std::lower_bound( pTail.begin(), pTail.end(), id );
+      if( it == pTail.end() || *it != id )
+        return false;
+      pTail.erase( it );
+      --pCount;
+      return true;
+    }
+
+    if( pHeaders[block].min > id )
+      return false;
+
+    std::vector<docid_t> ids;
+    decode( block, ids );
+    auto it = std::lower_bound( ids.begin(), ids.end(), id );
+    if( it == ids.end() || *it != id )
+      return false;
+    ids.erase( it );
+    replaceBlock( block, ids );
+    --pCount;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Replace a block with the blocks encoding the given ids
+  //----------------------------------------------------------------------------
+  void PostingList::replaceBlock( size_t                      block,
+                                  const std::vector<docid_t> &ids )
+  {
+    std::vector<BlockHeader> headers;
+    std::vector<uint8_t>     data;
+
+    //--------------------------------------------------------------------------
+    // Split overflowing packed blocks in halves so that the following
+    // inserts do not keep producing single-posting blocks; the other
+    // containers pick the best encoding again
+    //--------------------------------------------------------------------------
+    if( !ids.empty() )
+    {
+      if( pHeaders[block].type == PackedBlock )
+      {
+        uint32_t limit = BlockSize;
+        if( ids.size() > BlockSize )
+          limit = (ids.size()+1)/2;
+        appendBlocks( headers, data, ids.data(), ids.size(), limit );
+      }
+      else
+        appendContainer( headers, data, ids.data(), ids.size() );
+    }
+
+    uint64_t offset = pHeaders[block].offset;
+    uint32_t length = pHeaders[block].length;
+    int64_t  delta  = (int64_t)data.size() - length;
+    auto dataIt = pData.begin() + offset;
+    dataIt = pData.erase( dataIt, dataIt + length );
+    pData.insert( dataIt, data.begin(), data.end() );
+
+    for( auto &h: headers )
+      h.offset += offset;
+    auto hdrIt = pHeaders.erase( pHeaders.begin() + block );
+    hdrIt = pHeaders.insert( hdrIt, headers.begin(), headers.end() );
+    for( hdrIt += headers.size(); hdrIt != pHeaders.end(); ++hdrIt )
+      hdrIt->offset += delta;
+  }
+
+  //----------------------------------------------------------------------------
+  // Encode the ids as a sequence of packed blocks
+  //----------------------------------------------------------------------------
+  void PostingList::appendBlocks( std::vector<BlockHeader> &headers,
+                                  std::vector<uint8_t>     &data,
+                                  const docid_t            *ids,
+                                  size_t                    num,
+                                  uint32_t                  limit )
+  {
+    size_t i = 0;
+    while( i < num )
+    {
+      uint32_t count = 1;
+      while( i+count < num && count < limit &&
+             PostingCodec::fits( ids[i], ids[i+count] ) )
+        ++count;
+
+      BlockHeader h;
+      h.min      = ids[i];
+      h.max      = ids[i+count-1];
+      h.offset   = data.size();
+      h.count    = count;
+      h.length   = PostingCodec::encode( data, ids+i, count );
+      h.type     = PackedBlock;
+      h.reserved = 0;
+      headers.push_back( h );
+      i += count;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Encode the ids of one chunk with the container taking the least space
+  //----------------------------------------------------------------------------
+  void PostingList::appendContainer( std::vector<BlockHeader> &headers,
+                                     std::vector<uint8_t>     &data,
+                                     const docid_t            *ids,
+                                     size_t                    num )
+  {
+    std::vector<BlockHeader> packedHeaders;
+    std::vector<uint8_t>     packedData;
+    appendBlocks( packedHeaders, packedData, ids, num, BlockSize );
+
+    size_t runs = 1;
+    for( size_t i = 1; i < num; ++i )
+      if( ids[i] != ids[i-1]+1 )
+        ++runs;
+
+    size_t packedSize = packedData.size() +
+      packedHeaders.size()*sizeof(BlockHeader);
+    size_t runSize    = 4*runs + sizeof(BlockHeader);
+    size_t bitmapSize = 8*BitmapWords + sizeof(BlockHeader);
+
+    BlockHeader h;
+    h.min      = ids[0];
+    h.max      = ids[num-1];
+    h.offset   = data.size();
+    h.count    = num;
+    h.reserved = 0;
+    docid_t base = chunkBase( ids[0] );
+
+    if( runSize <= packedSize && runSize <= bitmapSize )
+    {
+      h.type   = RunBlock;
+      h.length = 4*runs;
+      data.resize( h.offset + h.length );
+      uint8_t *out = data.data() + h.offset;
+      for( size_t i = 0; i < num; )
+      {
+        size_t k = i+1;
+        for( ; k < num && ids[k] == ids[k-1]+1; ++k );
+        uint16_t start  = ids[i] - base;
+        uint16_t length = k-i-1;
+        memcpy( out,   &start,  2 );
+        memcpy( out+2, &length, 2 );
+        out += 4;
+        i = k;
+      }
+    }
+    else if( num >= DenseCount || bitmapSize < packedSize )
+    {
+      h.type   = BitmapBlock;
+      h.length = 8*BitmapWords;
+      data.resize( h.offset + h.length );
+      uint8_t *out = data.data() + h.offset;
+      for( size_t i = 0; i < num; ++i )
+      {
+        uint64_t bit = ids[i] - base;
+        out[bit/8] |= 1 << (bit%8);
+      }
+    }
+    else
+    {
+      for( auto &ph: packedHeaders )
+        ph.offset += data.size();
+      headers.insert( headers.end(), packedHeaders.begin(),
+                      packedHeaders.end() );
+      data.insert( data.end(), packedData.begin(), packedData.end() );
+      return;
+    }
+    headers.push_back( h );
+  }
+
+  //----------------------------------------------------------------------------
+  // Estimate the intersection: every block of this list meets the postings
+  // of the other one that fall within its range, the ranges of the other
+  // one are assumed to be filled evenly
+  //----------------------------------------------------------------------------
+  uint64_t TermPostings::estimateIntersection( const TermPostings &other ) const
+  {
+    std::vector<Range> mine, theirs;
+    getRanges( *this, mine );
+    getRanges( other, theirs );
+
+    double estimate = 0;
+    size_t j        = 0;
+    for( auto &r: mine )
+    {
+      while( j < theirs.size() && theirs[j].max < r.min )
+        ++j;
+      double within = 0;
+      for( size_t k = j; k < theirs.size() && theirs[k].min <= r.max; ++k )
+      {
+        const Range &t   = theirs[k];
+        docid_t      lo  = std::max( r.min, t.min );
+        docid_t      hi  = std::min( r.max, t.max );
+        within += (double)t.count * (hi-lo+1) / (t.max-t.min+1);
+      }
+      estimate += std::min( (double)r.count,
+                            r.count * within / (r.max-r.min+1) );
+    }
+    return std::min<uint64_t>( estimate + 0.5,
+                               std::min( size(), other.size() ) );
+  }
+
+  //----------------------------------------------------------------------------
+  // Copy out the postings a block at a time
+  //----------------------------------------------------------------------------
+  size_t PostingReader::read( docid_t *out, size_t num )
+  {
+    size_t copied = 0;
+    while( copied < num )
+    {
+      if( pPos == pNum && !loadBlock() )
+        break;
+      size_t n = std::min<size_t>( pNum-pPos, num-copied );
+      std::copy( pCurrent+pPos, pCurrent+pPos+n, out+copied );
+      pPos   += n;
+      copied += n;
+    }
+    return copied;
+  }
+
+  //----------------------------------------------------------------------------
+  // Decode the next batch of postings
+  //----------------------------------------------------------------------------
+  bool PostingReader::loadBlock()
+  {
+    pPos     = 0;
+    pCurrent = pBuffer;
+    for( ; pPart < pPostings.numParts(); ++pPart, pBlock = 0 )
+    {
+      const PostingsView &part = pPostings.getPart( pPart );
+      while( pBlock < part.numBlocks() )
+      {
+        const PostingList::BlockHeader &h    = part.getBlockHeader( pBlock );
+        const uint8_t                  *data = part.getBlockData( pBlock );
+        pNum = 0;
+        if( part.isValid( pBlock ) )
+        {
+          switch( h.type )
+          {
+            case PostingList::PackedBlock:
+              pNum      = part.decodeBlock( pBlock++, pBuffer );
+              pDecoded += pNum;
+              return true;
+
+            case PostingList::BitmapBlock:
+              pNum = loadBitmap( h, data );
+              break;
+
+            case PostingList::RunBlock:
+              pNum = loadRuns( h, data );
+              break;
+          }
+        }
+        if( pNum )
+        {
+          pDecoded += pNum;
+          return true;
+        }
+        ++pBlock;
+        pInner = 0;
+        pBits  = 0;
+      }
+
+      if( pBlock == part.numBlocks() && part.tailSize() )
+      {
+        ++pBlock;
+        pNum      = part.tailSize();
+        pCurrent  = part.getTail();
+        pDecoded += pNum;
+        return true;
+      }
+    }
+    pNum = 0;
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  // Skip to the first posting not smaller than the target
+  //----------------------------------------------------------------------------
+  bool PostingReader::advance( docid_t target, docid_t &id )
+  {
+    if( pPos == pNum || pCurrent[pNum-1] < target )
+    {
+      skipBlocks( target );
+      do
+      {
+        if( !loadBlock() )
+          return false;
+      }
+      while( pCurrent[pNum-1] < target );
+    }
+
+    //--------------------------------------------------------------------------
+    // The target is in the buffer, gallop to it
+    //--------------------------------------------------------------------------
+    uint32_t lo = pPos, probe = pPos, step = 1;
+    while( probe < pNum && pCurrent[probe] < target )
+    {
+      lo     = probe+1;
+      probe += step;
+      step  *= 2;
+    }
+    pPos = std::lower_bound( pCurrent+lo, pCurrent+std::min( probe, pNum ),
+                             target ) - pCurrent;
+    id = pCurrent[pPos++];
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Position the reader so that the next block it loads is the first one
+  // that may hold the target; pBlock is the next block to load or, for
+  // bitmap and run blocks, the one being loaded
+  //----------------------------------------------------------------------------
+  void PostingReader::skipBlocks( docid_t target )
+  {
+    pPos = pNum = 0;
+    for( ; pPart < pPostings.numParts(); ++pPart, pBlock = 0 )
+    {
+      const PostingsView &part = pPostings.getPart( pPart );
+      if( part.maxId() < target )
+      {
+        pSkipped += part.numBlocks() - std::min( pBlock, part.numBlocks() );
+        pInner = 0;
+        pBits  = 0;
+        continue;
+      }
+
+      if( pBlock >= part.numBlocks() )
+        return;
+
+      size_t block = part.findBlock( target, pBlock );
+      if( block != pBlock )
+      {
+        pSkipped += block - pBlock;
+        pBlock    = block;
+        pInner = 0;
+        pBits  = 0;
+      }
+      if( pBlock < part.numBlocks() && part.isValid( pBlock ) )
+        seekInBlock( part.getBlockHeader( pBlock ),
+                     part.getBlockData( pBlock ), target );
+      return;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Move the position within a bitmap or a run block forward to the target
+  //----------------------------------------------------------------------------
+  void PostingReader::seekInBlock( const PostingList::BlockHeader &h,
+                                   const uint8_t                  *data,
+                                   docid_t                         target )
+  {
+    docid_t base = PostingList::chunkBase( h.min );
+    if( target <= base )
+      return;
+    docid_t offset = target - base;
+
+    if( h.type == PostingList::BitmapBlock )
+    {
+      uint32_t word = offset/64;
+      uint64_t mask = ~(uint64_t)0 << (offset%64);
+      if( word >= pInner )
+      {
+        memcpy( &pBits, data + 8*word, 8 );
+        pInner = word+1;
+      }
+      if( word+1 == pInner )
+        pBits &= mask;
+    }
+    else if( h.type == PostingList::RunBlock )
+    {
+      while( pInner < h.length )
+      {
+        uint16_t start, length;
+        memcpy( &start,  data+pInner,   2 );
+        memcpy( &length, data+pInner+2, 2 );
+        if( (docid_t)start + length >= offset )
+        {
+          if( offset > start )
+            pBits = std::max<uint64_t>( pBits, offset-start );
+          break;
+        }
+        pInner += 4;
+        pBits   = 0;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Extract the next postings from a bitmap block; pInner is the next word
+  // to load and pBits the bits of the current one that are yet to be seen
+  //----------------------------------------------------------------------------
+  uint32_t PostingReader::loadBitmap( const PostingList::BlockHeader &h,
+                                      const uint8_t                  *data )
+  {
+    docid_t  base = PostingList::chunkBase( h.min );
+    uint32_t num  = 0;
+    while( num < PostingList::BlockSize )
+    {
+      while( !pBits )
+      {
+        if( pInner == PostingList::BitmapWords )
+          return num;
+        memcpy( &pBits, data + 8*pInner, 8 );
+        ++pInner;
+      }
+      pBuffer[num++] = base + 64*(pInner-1) + __builtin_ctzll( pBits );
+      pBits &= pBits-1;
+    }
+    return num;
+  }
+
+  //----------------------------------------------------------------------------
+  // Extract the next postings from a run block; pInner is the offset of
+  // the current run and pBits the position within it
+  //----------------------------------------------------------------------------
+  uint32_t PostingReader::loadRuns( const PostingList::BlockHeader &h,
+                                    const uint8_t                  *data )
+  {
+    docid_t  base = PostingList::chunkBase( h.min );
+    uint32_t num  = 0;
+    while( num < PostingList::BlockSize && pInner < h.length )
+    {
+      uint16_t start, length;
+      memcpy( &start,  data+pInner,   2 );
+      memcpy( &length, data+pInner+2, 2 );
+      for( ; num < PostingList::BlockSize && pBits <= length; ++pBits )
+        pBuffer[num++] = base + start + pBits;
+      if( pBits > length )
+      {
+        pInner += 4;
+        pBits   = 0;
+      }
+    }
+    return num;
+  }
+}
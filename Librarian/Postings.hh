@@ -0,0 +1,670 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <Librarian/PostingCodec.hh>
+
+namespace Librarian
+{
+  class Bitmap;
+  class PostingsView;
+
+  //----------------------------------------------------------------------------
+  //! Sorted list of postings split into blocks; every block has a header
+  //! holding its smallest and largest id so that lookups only decode the
+  //! block that may contain the id. The most recent postings are kept
+  //! uncompressed in an open tail block until it fills up.
+  //!
+  //! Blocks come in three flavours, Roaring style. Sparse postings are
+  //! packed with the PostingCodec, up to BlockSize of them per block.
+  //! Once a chunk of ChunkSize consecutive ids is complete, its postings
+  //! are re-encoded as whichever of packed blocks, a bitmap of the whole
+  //! chunk or a list of runs takes the least space; chunks holding
+  //! DenseCount or more postings always become bitmaps.
+  //----------------------------------------------------------------------------
+  class PostingList
+  {
+    public:
+      static const uint32_t BlockSize   = PostingCodec::MaxBlockSize;
+      static const uint32_t ChunkBits   = 16;
+      static const uint64_t ChunkSize   = (uint64_t)1 << ChunkBits;
+      static const uint32_t BitmapWords = ChunkSize/64;
+      static const uint32_t DenseCount  = 4096;
+
+      enum BlockType
+      {
+        PackedBlock = 0,   //!< PostingCodec encoded ids
+        BitmapBlock = 1,   //!< BitmapWords words covering the whole chunk
+        RunBlock    = 2    //!< (start, length-1) pairs of 16-bit offsets
+      };
+
+      //------------------------------------------------------------------------
+      //! Block header
+      //------------------------------------------------------------------------
+      struct BlockHeader
+      {
+        docid_t  min;
+        docid_t  max;
+        uint64_t offset;
+        uint32_t count;
+        uint16_t length;
+        uint8_t  type;
+        uint8_t  reserved;
+      };
+
+      //------------------------------------------------------------------------
+      //! First id of the chunk the id belongs to
+      //------------------------------------------------------------------------
+      static docid_t chunkBase( docid_t id )
+      {
+        return id & ~(ChunkSize-1);
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of postings
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pCount;
+      }
+
+      //------------------------------------------------------------------------
+      //! Is the list empty
+      //------------------------------------------------------------------------
+      bool empty() const
+      {
+        return pCount == 0;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of blocks, not counting the tail
+      //------------------------------------------------------------------------
+      size_t numBlocks() const
+      {
+        return pHeaders.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the header of the given block
+      //------------------------------------------------------------------------
+      const BlockHeader &getBlockHeader( size_t block ) const
+      {
+        return pHeaders[block];
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the data of the given block
+      //------------------------------------------------------------------------
+      const uint8_t *getBlockData( size_t block ) const
+      {
+        return pData.data() + pHeaders[block].offset;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the data of all the blocks
+      //------------------------------------------------------------------------
+      const uint8_t *getData() const
+      {
+        return pData.data();
+      }
+
+      //------------------------------------------------------------------------
+      //! Length of the data of all the blocks
+      //------------------------------------------------------------------------
+      size_t dataLength() const
+      {
+        return pData.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Decode the given packed block
+      //!
+      //! @param out buffer of at least BlockSize entries
+      //! @return    number of decoded ids
+      //------------------------------------------------------------------------
+      uint32_t decodeBlock( size_t block, docid_t *out ) const;
+
+      //------------------------------------------------------------------------
+      //! Append all the ids of a block of any type to the vector
+      //------------------------------------------------------------------------
+      void decode( size_t block, std::vector<docid_t> &out ) const;
+
+      //------------------------------------------------------------------------
+      //! Uncompressed postings following the last block
+      //------------------------------------------------------------------------
+      const std::vector<docid_t> &getTail() const
+      {
+        return pTail;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of postings held in bitmap and run blocks
+      //------------------------------------------------------------------------
+      uint64_t denseCount() const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the postings in the bitmap
+      //------------------------------------------------------------------------
+      void fill( Bitmap &bitmap ) const;
+
+      //------------------------------------------------------------------------
+      //! Read-only view of the postings, valid until the list is modified
+      //------------------------------------------------------------------------
+      PostingsView view() const;
+
+      //------------------------------------------------------------------------
+      //! Memory used by the postings in bytes
+      //------------------------------------------------------------------------
+      size_t memoryUsage() const
+      {
+        return pData.capacity() + pHeaders.capacity()*sizeof(BlockHeader) +
+          pTail.capacity()*sizeof(docid_t);
+      }
+
+      //------------------------------------------------------------------------
+      //! Add a posting keeping the list sorted
+      //!
+      //! @return false if the posting was already there
+      //------------------------------------------------------------------------
+      bool add( docid_t id )
+      {
+        if( !pTail.empty() && pTail.back() < id && pTail.size() < BlockSize &&
+            chunkBase( id ) == chunkBase( pTail.back() ) )
+        {
+          pTail.push_back( id );
+          ++pCount;
+          return true;
+        }
+        return addSlow( id );
+      }
+
+      //------------------------------------------------------------------------
+      //! Remove a posting
+      //!
+      //! @return false if the posting was not there
+      //------------------------------------------------------------------------
+      bool remove( docid_t id );
+
+      //------------------------------------------------------------------------
+      //! Compress the tail block
+      //------------------------------------------------------------------------
+      void flushTail();
+
+      //------------------------------------------------------------------------
+      //! Pick the containers for the last chunk and compress the tail, to be
+      //! called when no more postings are expected
+      //------------------------------------------------------------------------
+      void seal();
+
+      //------------------------------------------------------------------------
+      //! Encode the tail as packed blocks without modifying the list, the
+      //! offsets are relative to the beginning of data
+      //------------------------------------------------------------------------
+      void encodeTail( std::vector<BlockHeader> &headers,
+                       std::vector<uint8_t>     &data ) const
+      {
+        appendBlocks( headers, data, pTail.data(), pTail.size(), BlockSize );
+      }
+
+      //------------------------------------------------------------------------
+      //! Replace the contents of the list with already encoded blocks
+      //!
+      //! @return false if the blocks are inconsistent
+      //------------------------------------------------------------------------
+      bool assign( const BlockHeader *headers,
+                   size_t             numBlocks,
+                   const uint8_t     *data,
+                   size_t             length );
+
+      //------------------------------------------------------------------------
+      //! Find the first block that may contain the id, ie. the first block
+      //! with the largest id not smaller than the one given
+      //!
+      //! @return numBlocks() if there is no such block
+      //------------------------------------------------------------------------
+      size_t findBlock( docid_t id ) const;
+
+    private:
+      bool addSlow( docid_t id );
+      bool insert( docid_t id );
+      void compactChunk( docid_t base );
+      void replaceBlock( size_t block, const std::vector<docid_t> &ids );
+      static void appendBlocks( std::vector<BlockHeader> &headers,
+                                std::vector<uint8_t>     &data,
+                                const docid_t            *ids,
+                                size_t                    num,
+                                uint32_t                  limit );
+      static void appendContainer( std::vector<BlockHeader> &headers,
+                                   std::vector<uint8_t>     &data,
+                                   const docid_t            *ids,
+                                   size_t                    num );
+
+      uint64_t                 pCount = 0;
+      std::vector<BlockHeader> pHeaders;
+      std::vector<uint8_t>     pData;
+      std::vector<docid_t>     pTail;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Statistics of encoded postings, the query planner estimates costs
+  //! with them
+  //----------------------------------------------------------------------------
+  struct PostingStatistics
+  {
+    uint64_t documents  = 0;  //!< number of postings, document frequency
+    uint64_t blocks     = 0;  //!< number of blocks, the tail counts as one
+    uint64_t bytes      = 0;  //!< size of the encoded blocks and the tail
+    uint64_t dense      = 0;  //!< postings in bitmap and run blocks
+    uint64_t denseBytes = 0;  //!< size of the bitmap and run blocks
+
+    PostingStatistics &operator += ( const PostingStatistics &other )
+    {
+      documents  += other.documents;
+      blocks     += other.blocks;
+      bytes      += other.bytes;
+      dense      += other.dense;
+      denseBytes += other.denseBytes;
+      return *this;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  //! Read-only view of encoded postings: the block headers, the block data
+  //! and the uncompressed tail. It does not own the memory, so it may as
+  //! well point to a PostingList as to a mapped index file.
+  //----------------------------------------------------------------------------
+  class PostingsView
+  {
+    public:
+      typedef PostingList::BlockHeader BlockHeader;
+
+      //------------------------------------------------------------------------
+      //! Constructor, empty view
+      //------------------------------------------------------------------------
+      PostingsView() {}
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param dataLength length of the data of all the blocks, the block
+      //!                   headers pointing past it are not trusted
+      //------------------------------------------------------------------------
+      PostingsView( const BlockHeader *headers,
+                    size_t             numBlocks,
+                    const uint8_t     *data,
+                    uint64_t           dataLength,
+                    const docid_t     *tail,
+                    size_t             tailSize,
+                    uint64_t           count ):
+        pHeaders( headers ), pNumBlocks( numBlocks ), pData( data ),
+        pDataLength( dataLength ), pTail( tail ), pTailSize( tailSize ),
+        pCount( count ) {}
+
+      //------------------------------------------------------------------------
+      //! Number of postings
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pCount;
+      }
+
+      //------------------------------------------------------------------------
+      //! Is the view empty
+      //------------------------------------------------------------------------
+      bool empty() const
+      {
+        return pCount == 0;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of blocks, not counting the tail
+      //------------------------------------------------------------------------
+      size_t numBlocks() const
+      {
+        return pNumBlocks;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the header of the given block
+      //------------------------------------------------------------------------
+      const BlockHeader &getBlockHeader( size_t block ) const
+      {
+        return pHeaders[block];
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the data of the given block
+      //------------------------------------------------------------------------
+      const uint8_t *getBlockData( size_t block ) const
+      {
+        return pData + pHeaders[block].offset;
+      }
+
+      //------------------------------------------------------------------------
+      //! Uncompressed postings following the last block
+      //------------------------------------------------------------------------
+      const docid_t *getTail() const
+      {
+        return pTail;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of uncompressed postings following the last block
+      //------------------------------------------------------------------------
+      size_t tailSize() const
+      {
+        return pTailSize;
+      }
+
+      //------------------------------------------------------------------------
+      //! Check that the header of a block is consistent: its type is known,
+      //! it holds as many postings as the type allows, its data lies within
+      //! the data of the view and, for a dense block, its ids stay within
+      //! a single chunk. The mapped files are not verified when they are
+      //! opened, so the readers skip the blocks failing this.
+      //------------------------------------------------------------------------
+      bool isValid( size_t block ) const;
+
+      //------------------------------------------------------------------------
+      //! Decode the given packed block, it needs to be valid
+      //!
+      //! @param out buffer of at least BlockSize entries
+      //! @return    number of decoded ids
+      //------------------------------------------------------------------------
+      uint32_t decodeBlock( size_t block, docid_t *out ) const
+      {
+        const BlockHeader &h = pHeaders[block];
+        PostingCodec::decode( out, pData+h.offset, h.length, h.min, h.count );
+        return h.count;
+      }
+
+      //------------------------------------------------------------------------
+      //! Append all the ids of a block of any type to the vector, nothing
+      //! for an invalid block
+      //------------------------------------------------------------------------
+      void decode( size_t block, std::vector<docid_t> &out ) const;
+
+      //------------------------------------------------------------------------
+      //! Number of postings held in bitmap and run blocks
+      //------------------------------------------------------------------------
+      uint64_t denseCount() const;
+
+      //------------------------------------------------------------------------
+      //! Gather the statistics from the block headers
+      //------------------------------------------------------------------------
+      PostingStatistics getStatistics() const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the postings in the bitmap, the invalid blocks
+      //! and the ids past the bitmap are skipped
+      //------------------------------------------------------------------------
+      void fill( Bitmap &bitmap ) const;
+
+      //------------------------------------------------------------------------
+      //! Find the first block that may contain the id
+      //!
+      //! @return numBlocks() if there is no such block
+      //------------------------------------------------------------------------
+      size_t findBlock( docid_t id ) const;
+
+      //------------------------------------------------------------------------
+      //! Find the first block at or after the given one that may contain
+      //! the id, galloping from there, so that short skips stay cheap
+      //!
+      //! @return numBlocks() if there is no such block
+      //------------------------------------------------------------------------
+      size_t findBlock( docid_t id, size_t from ) const;
+
+      //------------------------------------------------------------------------
+      //! The largest id of the view, 0 if it is empty
+      //------------------------------------------------------------------------
+      docid_t maxId() const
+      {
+        if( pTailSize )
+          return pTail[pTailSize-1];
+        return pNumBlocks ? pHeaders[pNumBlocks-1].max : 0;
+      }
+
+    private:
+      const BlockHeader *pHeaders    = 0;
+      size_t             pNumBlocks  = 0;
+      const uint8_t     *pData       = 0;
+      uint64_t           pDataLength = 0;
+      const docid_t     *pTail       = 0;
+      size_t             pTailSize   = 0;
+      uint64_t           pCount      = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  // Read-only view of the postings
+  //----------------------------------------------------------------------------
+  inline PostingsView PostingList::view() const
+  {
+    return PostingsView( pHeaders.data(), pHeaders.size(), pData.data(),
+                         pData.size(), pTail.data(), pTail.size(), pCount );
+  }
+
+  //----------------------------------------------------------------------------
+  // Decode the given packed block
+  //----------------------------------------------------------------------------
+  inline uint32_t PostingList::decodeBlock( size_t block, docid_t *out ) const
+  {
+    return view().decodeBlock( block, out );
+  }
+
+  //----------------------------------------------------------------------------
+  //! Postings of a term spread over a number of views holding disjoint and
+  //! ascending id ranges, like the segments of an index
+  //----------------------------------------------------------------------------
+  class TermPostings
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor, no postings
+      //------------------------------------------------------------------------
+      TermPostings() {}
+
+      //------------------------------------------------------------------------
+      //! Constructor, postings of a single view
+      //------------------------------------------------------------------------
+      TermPostings( const PostingsView &view )
+      {
+        add( view );
+      }
+
+      //------------------------------------------------------------------------
+      //! Append a view, its ids need to follow the ones already there
+      //------------------------------------------------------------------------
+      void add( const PostingsView &view )
+      {
+        if( view.empty() )
+          return;
+        pParts.push_back( view );
+        pCount += view.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Remove all the views
+      //------------------------------------------------------------------------
+      void clear()
+      {
+        pParts.clear();
+        pCount = 0;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of postings
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pCount;
+      }
+
+      //------------------------------------------------------------------------
+      //! Are there any postings
+      //------------------------------------------------------------------------
+      bool empty() const
+      {
+        return pCount == 0;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of views
+      //------------------------------------------------------------------------
+      size_t numParts() const
+      {
+        return pParts.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get a view
+      //------------------------------------------------------------------------
+      const PostingsView &getPart( size_t part ) const
+      {
+        return pParts[part];
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of postings held in bitmap and run blocks
+      //------------------------------------------------------------------------
+      uint64_t denseCount() const
+      {
+        uint64_t count = 0;
+        for( auto &part: pParts )
+          count += part.denseCount();
+        return count;
+      }
+
+      //------------------------------------------------------------------------
+      //! Gather the statistics of all the parts
+      //------------------------------------------------------------------------
+      PostingStatistics getStatistics() const
+      {
+        PostingStatistics stats;
+        for( auto &part: pParts )
+          stats += part.getStatistics();
+        return stats;
+      }
+
+      //------------------------------------------------------------------------
+      //! Estimate the number of postings shared with the other list from
+      //! the id ranges of the blocks, assuming independence only within
+      //! the ranges; this sees the correlation of clustered ids that the
+      //! document frequencies alone miss
+      //------------------------------------------------------------------------
+      uint64_t estimateIntersection( const TermPostings &other ) const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the postings in the bitmap
+      //------------------------------------------------------------------------
+      void fill( Bitmap &bitmap ) const
+      {
+        for( auto &part: pParts )
+          part.fill( bitmap );
+      }
+
+    private:
+      std::vector<PostingsView> pParts;
+      uint64_t                  pCount = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Read postings sequentially, decoding at most BlockSize ids at a time
+  //----------------------------------------------------------------------------
+  class PostingReader
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      PostingReader( const TermPostings &postings ): pPostings( postings ) {}
+
+      //------------------------------------------------------------------------
+      //! Get the next posting
+      //!
+      //! @return false if there are no more postings
+      //------------------------------------------------------------------------
+      bool next( docid_t &id )
+      {
+        if( pPos == pNum && !loadBlock() )
+          return false;
+        id = pCurrent[pPos++];
+        return true;
+      }
+
+      //------------------------------------------------------------------------
+      //! Skip to the first posting not smaller than the target, the blocks
+      //! ending before it are not decoded
+      //!
+      //! @return false if there is no such posting
+      //------------------------------------------------------------------------
+      bool advance( docid_t target, docid_t &id );
+
+      //------------------------------------------------------------------------
+      //! Copy out up to num postings a block at a time
+      //!
+      //! @return number of postings copied, less than num only at the end
+      //------------------------------------------------------------------------
+      size_t read( docid_t *out, size_t num );
+
+      //------------------------------------------------------------------------
+      //! Number of postings decoded so far
+      //------------------------------------------------------------------------
+      uint64_t getDecoded() const
+      {
+        return pDecoded;
+      }
+
+      //------------------------------------------------------------------------
+      //! Number of blocks skipped over by advance without being decoded
+      //------------------------------------------------------------------------
+      uint64_t getSkipped() const
+      {
+        return pSkipped;
+      }
+
+    private:
+      void skipBlocks( docid_t target );
+      void seekInBlock( const PostingList::BlockHeader &h,
+                        const uint8_t                  *data,
+                        docid_t                         target );
+      bool loadBlock();
+      uint32_t loadBitmap( const PostingList::BlockHeader &h,
+                           const uint8_t                  *data );
+      uint32_t loadRuns( const PostingList::BlockHeader &h,
+                         const uint8_t                  *data );
+
+      TermPostings   pPostings;
+      const docid_t *pCurrent = 0;
+      uint32_t       pPos     = 0;
+      uint32_t       pNum     = 0;
+      size_t         pPart    = 0;
+      size_t         pBlock   = 0;
+      uint32_t       pInner   = 0;
+      uint64_t       pBits    = 0;
+      uint64_t       pDecoded = 0;
+      uint64_t       pSkipped = 0;
+      docid_t        pBuffer[PostingList::BlockSize];
+  };
+}
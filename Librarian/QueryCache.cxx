@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <Librarian/QueryCache.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Find the documents matching a query
+  //----------------------------------------------------------------------------
+  bool QueryCache::find( std::vector<docid_t> &docs,
+                         const std::string    &key,
+                         uint64_t              version )
+  {
+    const PostingList *entry = pEntries.find( key, version );
+    if( !entry )
+      return false;
+
+    docs.resize( entry->size() );
+    PostingReader reader( TermPostings( entry->view() ) );
+    docs.resize( reader.read( docs.data(), docs.size() ) );
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Store the documents matching a query, sealed so that they take the
+  // blocks suiting their density
+  //----------------------------------------------------------------------------
+  void QueryCache::insert( const std::string          &key,
+                           const std::vector<docid_t> &docs,
+                           uint64_t                    version )
+  {
+    if( pEntries.contains( key, version ) )
+      return;
+
+    PostingList list;
+    for( auto id: docs )
+      list.add( id );
+    list.seal();
+    size_t size = list.memoryUsage();
+    pEntries.insert( key, std::move( list ), size, version );
+  }
+}
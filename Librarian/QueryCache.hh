@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Librarian/Postings.hh>
+#include <Librarian/LRUCache.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Results of the queries run recently, keyed by the canonical text of
+  //! the query
+  //!
+  //! The documents are kept as sealed posting lists, so that the dense
+  //! results take bitmap or run blocks and the sparse ones packed blocks.
+  //! The entries live in a segmented LRUCache, ProtectedShare percent of
+  //! the budget going to the queries hit more than once.
+  //----------------------------------------------------------------------------
+  class QueryCache
+  {
+    public:
+      //! Percentage of the budget the protected entries may take
+      static const size_t ProtectedShare = 80;
+
+      typedef LRUCache<PostingList>::Statistics Statistics;
+
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param budget maximal number of bytes the entries may take
+      //------------------------------------------------------------------------
+      QueryCache( size_t budget ): pEntries( budget, ProtectedShare ) {}
+
+      //------------------------------------------------------------------------
+      //! Find the documents matching a query
+      //!
+      //! @param docs    the documents, sorted
+      //! @param key     canonical text of the query
+      //! @param version version of the index the documents need to match
+      //! @return        false if the query is not cached
+      //------------------------------------------------------------------------
+      bool find( std::vector<docid_t> &docs,
+                 const std::string    &key,
+                 uint64_t              version );
+
+      //------------------------------------------------------------------------
+      //! Store the documents matching a query, see LRUCache::insert
+      //!
+      //! @param key     canonical text of the query
+      //! @param docs    the documents, sorted
+      //! @param version version of the index the documents come from
+      //------------------------------------------------------------------------
+      void insert( const std::string          &key,
+                   const std::vector<docid_t> &docs,
+                   uint64_t                    version );
+
+      //------------------------------------------------------------------------
+      //! Drop all the entries
+      //------------------------------------------------------------------------
+      void clear()
+      {
+        pEntries.clear();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the counters
+      //------------------------------------------------------------------------
+      const Statistics &getStatistics() const
+      {
+        return pEntries.getStatistics();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the maximal number of bytes the entries may take
+      //------------------------------------------------------------------------
+      size_t getBudget() const
+      {
+        return pEntries.getBudget();
+      }
+
+    private:
+      LRUCache<PostingList> pEntries;
+  };
+}
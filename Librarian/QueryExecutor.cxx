@@ -23,34 +23,341 @@
 #include <string>
 #include <algorithm>
 #include <cstring>
+#include <cmath>
 #include <memory>
+#include <string_view>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
 
 #include <Librarian/QueryExecutor.hh>
 #include <Librarian/QueryParser.hh>
-#include <Librarian/Index.hh>
+#include <Librarian/QueryRewriter.hh>
+#include <Librarian/IndexReader.hh>
+#include <Librarian/LevenshteinAutomaton.hh>
+#include <Librarian/IntersectionKernels.hh>
+#include <Librarian/Bitmap.hh>
 #include <Librarian/Status.hh>
 
 using namespace Librarian;
 
 namespace
 {
+  //----------------------------------------------------------------------------
+  //! Cost model of the planner
+  //!
+  //! The costs are counted in document ids decoded or compared and in
+  //! bitmap words touched. The operands are assumed to be independent,
+  //! each one holding a count/N share of the N documents, unless there is
+  //! something better to go by.
+  //----------------------------------------------------------------------------
+  struct CostModel
+  {
+    //--------------------------------------------------------------------------
+    //! Number of documents, at least one
+    //--------------------------------------------------------------------------
+    static double documents( const IndexReader *index )
+    {
+      return std::max<double>( index->numDocuments(), 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    //! Number of words of a bitmap covering the index
+    //--------------------------------------------------------------------------
+    static double words( const IndexReader *index )
+    {
+      return (index->maxDocId()+1)/64.0;
+    }
+
+    //--------------------------------------------------------------------------
+    //! Move a list forward to each of the targets in turn: it gallops over
+    //! the blocks, but never costs more than going through all of it
+    //--------------------------------------------------------------------------
+    static double skip( double targets, double length )
+    {
+      if( targets < 1 )
+        return 0;
+      return std::min( targets*std::log2( 2 + length/targets ),
+                       targets + length );
+    }
+
+    //--------------------------------------------------------------------------
+    //! Merge the lists of the given total length in a heap of k of them
+    //--------------------------------------------------------------------------
+    static double heap( double length, size_t k )
+    {
+      return length*(1 + std::log2( std::max<size_t>( k, 1 ) ));
+    }
+
+    //--------------------------------------------------------------------------
+    //! Size of the union of operands of the given sizes
+    //--------------------------------------------------------------------------
+    template<typename Counts>
+    static uint64_t unionCount( const IndexReader *index, const Counts &counts )
+    {
+      double n    = documents( index );
+      double none = 1;
+      for( double c: counts )
+        none *= 1 - std::min( c/n, 1.0 );
+      return n*(1 - none) + 0.5;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  //! Counters of a node collected while a query is analyzed
+  //----------------------------------------------------------------------------
+  struct Profile
+  {
+    uint64_t rows     = 0;
+    uint64_t loads    = 0;
+    uint64_t advances = 0;
+    uint64_t fills    = 0;
+    double   time     = 0;
+    docid_t  last     = (docid_t)-1;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Add the time spent in its scope to the profile, if there is one
+  //----------------------------------------------------------------------------
+  class ProfileTimer
+  {
+    public:
+      ProfileTimer( Profile *profile ): pProfile( profile )
+      {
+        if( pProfile )
+          pStart = std::chrono::steady_clock::now();
+      }
+
+      ~ProfileTimer()
+      {
+        if( pProfile )
+          pProfile->time += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - pStart ).count();
+      }
+
+    private:
+      Profile                               *pProfile;
+      std::chrono::steady_clock::time_point  pStart;
+  };
+
   //----------------------------------------------------------------------------
   //! Abstract node
+  //!
+  //! The parents go through the non-virtual interface, so that the calls
+  //! can be counted and timed when the query is analyzed
   //----------------------------------------------------------------------------
   class Node
   {
     public:
       virtual ~Node() {}
-      virtual void prepare( const Index *index ) = 0;
       virtual docid_t getResult() const = 0;
-      virtual bool loadResult() = 0;
+
+      //------------------------------------------------------------------------
+      //! Pick the plan, the counts and the costs are known afterwards
+      //------------------------------------------------------------------------
+      void prepare( const IndexReader *index )
+      {
+        ProfileTimer timer( pProfile.get() );
+        doPrepare( index );
+      }
+
+      //------------------------------------------------------------------------
+      //! Move to the next result
+      //!
+      //! @return false if there is none
+      //------------------------------------------------------------------------
+      bool loadResult()
+      {
+        if( !pProfile )
+          return doLoadResult();
+        ProfileTimer timer( pProfile.get() );
+        ++pProfile->loads;
+        return countRow( doLoadResult() );
+      }
+
+      //------------------------------------------------------------------------
+      //! Move to the first result not smaller than the target, stay if the
+      //! current one already is
+      //!
+      //! @return false if there is no such result
+      //------------------------------------------------------------------------
+      bool advance( docid_t target )
+      {
+        if( !pProfile )
+          return doAdvance( target );
+        ProfileTimer timer( pProfile.get() );
+        ++pProfile->advances;
+        return countRow( doAdvance( target ) );
+      }
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the results in the bitmap; this is used instead
+      //! of iterating over the results, never after
+      //------------------------------------------------------------------------
+      void fill( Bitmap &bitmap )
+      {
+        ProfileTimer timer( pProfile.get() );
+        if( pProfile )
+          ++pProfile->fills;
+        doFill( bitmap );
+      }
+
+      //------------------------------------------------------------------------
+      //! Can the node produce a bitmap of its results with word-wide
+      //! operations rather than one document at a time
+      //------------------------------------------------------------------------
+      virtual bool isDense() const { return false; }
+
+      //------------------------------------------------------------------------
+      //! Name of the operator followed by the details of its plan
+      //------------------------------------------------------------------------
+      virtual std::string describe() const = 0;
+
+      //------------------------------------------------------------------------
+      //! Get the children in the order they are executed in
+      //------------------------------------------------------------------------
+      virtual void getChildren( std::vector<Node*> & ) {}
+
+      //------------------------------------------------------------------------
+      //! Add the numbers of postings decoded and of blocks skipped
+      //!
+      //! @return false if the node does not read postings itself
+      //------------------------------------------------------------------------
+      virtual bool countPostings( uint64_t &, uint64_t & ) const
+      {
+        return false;
+      }
+
+      //------------------------------------------------------------------------
+      //! Start collecting the counters of the node
+      //------------------------------------------------------------------------
+      void enableProfile()
+      {
+        pProfile.reset( new Profile );
+      }
+
+      const Profile *getProfile() const
+      {
+        return pProfile.get();
+      }
 
       uint64_t getCount() const
       {
         return pCount;
       }
+
+      //------------------------------------------------------------------------
+      //! Estimated cost of going through all the results one by one
+      //------------------------------------------------------------------------
+      double getCost() const
+      {
+        return pCost;
+      }
+
+      //------------------------------------------------------------------------
+      //! Estimated cost of fill
+      //------------------------------------------------------------------------
+      virtual double getFillCost() const
+      {
+        return pBitmap ? pBitmap->numWords() : pCost + pCount;
+      }
+
+      //------------------------------------------------------------------------
+      //! Bitmap of all the results if the node has planned one, it is
+      //! materialized now if it has not been yet
+      //------------------------------------------------------------------------
+      virtual const Bitmap *getBitmap()
+      {
+        return pBitmap.get();
+      }
     protected:
-      uint64_t pCount = 0;
+      virtual void doPrepare( const IndexReader *index ) = 0;
+      virtual bool doLoadResult() = 0;
+
+      virtual bool doAdvance( docid_t target )
+      {
+        if( getResult() != (docid_t)-1 && getResult() >= target )
+          return true;
+        while( doLoadResult() )
+          if( getResult() >= target )
+            return true;
+        return false;
+      }
+
+      virtual void doFill( Bitmap &bitmap )
+      {
+        while( doLoadResult() )
+          if( getResult() < bitmap.size() )
+            bitmap.set( getResult() );
+      }
+
+      //------------------------------------------------------------------------
+      // Iterate over the results materialized in a bitmap
+      //------------------------------------------------------------------------
+      bool loadFromBitmap( docid_t &doc )
+      {
+        return loadFromBitmap( doc, *pBitmap );
+      }
+
+      bool loadFromBitmap( docid_t &doc, const Bitmap &bitmap )
+      {
+        pNextBit = bitmap.next( pNextBit );
+        if( pNextBit == Bitmap::npos )
+        {
+          doc = (docid_t)-1;
+          return false;
+        }
+        doc = pNextBit++;
+        return true;
+      }
+
+      //------------------------------------------------------------------------
+      // Skip to the first result materialized in a bitmap not smaller than
+      // the target
+      //------------------------------------------------------------------------
+      bool advanceInBitmap( docid_t &doc, docid_t target )
+      {
+        return advanceInBitmap( doc, target, *pBitmap );
+      }
+
+      bool advanceInBitmap( docid_t &doc, docid_t target,
+                            const Bitmap &bitmap )
+      {
+        if( doc != (docid_t)-1 && doc >= target )
+          return true;
+        pNextBit = std::max<uint64_t>( pNextBit, target );
+        return loadFromBitmap( doc, bitmap );
+      }
+
+      //------------------------------------------------------------------------
+      // Create a bitmap able to hold all the documents of the index
+      //------------------------------------------------------------------------
+      static Bitmap *newBitmap( const IndexReader *index )
+      {
+        return new Bitmap( index->maxDocId()+1 );
+      }
+
+      uint64_t                 pCount   = 0;
+      double                   pCost    = 0;
+      std::unique_ptr<Bitmap>  pBitmap;
+      uint64_t                 pNextBit = 0;
+
+    private:
+      //------------------------------------------------------------------------
+      // Count the result the node has moved to, a successful advance may
+      // stay where it is
+      //------------------------------------------------------------------------
+      bool countRow( bool found )
+      {
+        if( found && getResult() != pProfile->last )
+        {
+          ++pProfile->rows;
+          pProfile->last = getResult();
+        }
+        return found;
+      }
+
+      std::unique_ptr<Profile> pProfile;
   };
 
   //----------------------------------------------------------------------------
@@ -59,47 +366,173 @@ namespace
   class DataLoader
   {
     public:
-      DataLoader(const TermData::Postings *postings): pPostings(postings)
-      { pCurrent = pPostings->begin(); }
-      virtual docid_t getResult() const { return pDoc; }
+      DataLoader(const TermPostings &postings): pReader(postings) {}
+      docid_t getResult() const { return pDoc; }
+      const PostingReader &getReader() const { return pReader; }
+
+      bool loadResult()
+      {
+        if( !pReader.next( pDoc ) )
+        {
+          pDoc = (docid_t)-1;
+          return false;
+        }
+        return true;
+      }
 
-      virtual bool loadResult()
+      bool advance( docid_t target )
       {
-        if( pCurrent == pPostings->end() )
+        if( pDoc != (docid_t)-1 && pDoc >= target )
+          return true;
+        if( !pReader.advance( target, pDoc ) )
         {
           pDoc = (docid_t)-1;
           return false;
         }
-        pDoc = *pCurrent;
-        ++pCurrent;
         return true;
       }
 
     private:
-      const TermData::Postings           *pPostings = 0;
-      TermData::Postings::const_iterator  pCurrent;
-      docid_t                             pDoc      = (docid_t)-1;
+      PostingReader pReader;
+      docid_t       pDoc = (docid_t)-1;
   };
 
   //----------------------------------------------------------------------------
-  //! Intersection
+  //! Union of sorted sources, data loaders or nodes, positioned at their
+  //! next document; they are kept in a binary heap by that document, so
+  //! a result costs O(log k) rather than a scan of all k of them
   //----------------------------------------------------------------------------
-  class Intersection
+  template<typename Source>
+  class Union
   {
     public:
-      bool check(docid_t docId)
+      //------------------------------------------------------------------------
+      //! Add a source, the exhausted ones are dropped
+      //------------------------------------------------------------------------
+      void add( Source *source )
       {
-        for(auto n: pNodes)
+        if( source->getResult() != (docid_t)-1 )
+          pHeap.push_back( source );
+      }
+
+      //------------------------------------------------------------------------
+      //! Order the sources, needs to be called after adding them
+      //------------------------------------------------------------------------
+      void build()
+      {
+        std::make_heap( pHeap.begin(), pHeap.end(), later );
+      }
+
+      //------------------------------------------------------------------------
+      //! Take the smallest document and move all the sources having it
+      //! forward
+      //!
+      //! @return false if all the sources are exhausted
+      //------------------------------------------------------------------------
+      bool next( docid_t &doc )
+      {
+        if( pHeap.empty() )
         {
-          while(n->getResult() < docId && n->loadResult());
-          if(n->getResult() == docId)
-            continue;
+          doc = (docid_t)-1;
           return false;
         }
+
+        doc = pHeap.front()->getResult();
+        while( !pHeap.empty() && pHeap.front()->getResult() == doc )
+        {
+          if( !pHeap.front()->loadResult() )
+          {
+            pHeap.front() = pHeap.back();
+            pHeap.pop_back();
+          }
+          siftDown();
+        }
         return true;
       }
+
+      //------------------------------------------------------------------------
+      //! Skip the sources behind the target and take the smallest document;
+      //! only the ones that move are touched
+      //------------------------------------------------------------------------
+      bool advance( docid_t target, docid_t &doc )
+      {
+        while( !pHeap.empty() && pHeap.front()->getResult() < target )
+        {
+          if( !pHeap.front()->advance( target ) )
+          {
+            pHeap.front() = pHeap.back();
+            pHeap.pop_back();
+          }
+          siftDown();
+        }
+        return next( doc );
+      }
+
+    private:
+      static bool later( const Source *a, const Source *b )
+      {
+        return a->getResult() > b->getResult();
+      }
+
+      //------------------------------------------------------------------------
+      // Move the top of the heap down to its place after it has changed,
+      // one pass instead of a pop followed by a push
+      //------------------------------------------------------------------------
+      void siftDown()
+      {
+        size_t  size = pHeap.size();
+        size_t  pos  = 0;
+        Source *top  = size ? pHeap[0] : 0;
+        while( true )
+        {
+          size_t child = 2*pos+1;
+          if( child >= size )
+            break;
+          if( child+1 < size && later( pHeap[child], pHeap[child+1] ) )
+            ++child;
+          if( !later( top, pHeap[child] ) )
+            break;
+          pHeap[pos] = pHeap[child];
+          pos        = child;
+        }
+        if( size )
+          pHeap[pos] = top;
+      }
+
+      std::vector<Source*> pHeap;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Intersection
+  //----------------------------------------------------------------------------
+  class Intersection
+  {
+    public:
+      //------------------------------------------------------------------------
+      // Find the first document not smaller than the given one that all the
+      // nodes have: they leapfrog, each one skipping to where the previous
+      // one landed, until they agree
+      //
+      // @return -1 if there is none
+      //------------------------------------------------------------------------
+      docid_t align(docid_t docId)
+      {
+        size_t agreed = 0;
+        for(size_t i = 0; agreed < pNodes.size(); i = (i+1) % pNodes.size())
+        {
+          if(!pNodes[i]->advance(docId))
+            return (docid_t)-1;
+          if(pNodes[i]->getResult() == docId)
+            ++agreed;
+          else
+          {
+            docId  = pNodes[i]->getResult();
+            agreed = 1;
+          }
+        }
+        return docId;
+      }
       void addNode(Node *n) { pNodes.push_back(n); }
-      void loadNodes() { for(auto n: pNodes) n->loadResult(); }
     private:
       std::vector<Node*> pNodes;
   };
@@ -112,253 +545,1216 @@ namespace
     public:
       bool check(docid_t docId)
       {
-        for(auto n: pNodes)
+        for(auto n: pNodes)
+          if(n->advance(docId) && n->getResult() == docId)
+            return true;
+        return false;
+      }
+      void addNode(Node *n) { pNodes.push_back(n); }
+      size_t size() const { return pNodes.size(); }
+    private:
+      std::vector<Node*> pNodes;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Empty set, the operand of the NOT standing for all the documents
+  //----------------------------------------------------------------------------
+  class EmptyNode: public Node
+  {
+    public:
+      virtual void doPrepare( const IndexReader * ) {}
+      virtual docid_t getResult() const { return (docid_t)-1; }
+      virtual bool doLoadResult() { return false; }
+
+      //------------------------------------------------------------------------
+      // Dense, so that its complement is done word by word
+      //------------------------------------------------------------------------
+      virtual bool isDense() const { return true; }
+      virtual void doFill( Bitmap & ) {}
+      virtual std::string describe() const { return "EMPTY"; }
+  };
+
+  //----------------------------------------------------------------------------
+  //! Term node
+  //----------------------------------------------------------------------------
+  class TermNode: public Node
+  {
+    public:
+      TermNode( const std::string &term )
+      {
+        pTerm.resize(term.size());
+        std::transform(term.begin(), term.end(), pTerm.begin(), tolower);
+      }
+
+      virtual void doPrepare( const IndexReader *index )
+      {
+        if( index->findTerm( pTerm, pPostings ) )
+        {
+          pStats = pPostings.getStatistics();
+          pCount = pStats.documents;
+          pCost  = pStats.documents;
+          pDataLoader.reset( new DataLoader(pPostings) );
+        }
+      }
+
+      //------------------------------------------------------------------------
+      // A term missing from the index has no loader and no results
+      //------------------------------------------------------------------------
+      virtual docid_t getResult() const
+      {
+        return pDataLoader ? pDataLoader->getResult() : (docid_t)-1;
+      }
+
+      virtual bool doLoadResult()
+      {
+        return pDataLoader && pDataLoader->loadResult();
+      }
+
+      virtual bool doAdvance( docid_t target )
+      {
+        return pDataLoader && pDataLoader->advance( target );
+      }
+
+      //------------------------------------------------------------------------
+      // Dense if most of the postings live in bitmap or run containers
+      //------------------------------------------------------------------------
+      virtual bool isDense() const
+      {
+        return pStats.documents && 2*pStats.dense >= pStats.documents;
+      }
+
+      //------------------------------------------------------------------------
+      // The bitmap and run blocks are copied a word at a time
+      //------------------------------------------------------------------------
+      virtual double getFillCost() const
+      {
+        return pStats.denseBytes/8.0 + (pStats.documents - pStats.dense);
+      }
+
+      //------------------------------------------------------------------------
+      // Estimate the number of documents shared with the other term
+      //------------------------------------------------------------------------
+      uint64_t estimateIntersection( const TermNode &other ) const
+      {
+        return pPostings.estimateIntersection( other.pPostings );
+      }
+
+      //------------------------------------------------------------------------
+      // Only the packed blocks need to be decoded
+      //------------------------------------------------------------------------
+      virtual void doFill( Bitmap &bitmap )
+      {
+        pPostings.fill( bitmap );
+        pDecoded += pStats.documents - pStats.dense;
+      }
+
+      //------------------------------------------------------------------------
+      // Decode all the postings into an array, independently of the
+      // iteration
+      //------------------------------------------------------------------------
+      void collect( std::vector<docid_t> &ids )
+      {
+        ids.resize( pCount );
+        PostingReader reader( pPostings );
+        ids.resize( reader.read( ids.data(), ids.size() ) );
+        pDecoded += reader.getDecoded();
+      }
+
+      virtual std::string describe() const
+      {
+        std::string desc = "TERM \"" + pTerm + "\"";
+        if( !pDataLoader )
+          desc += " missing";
+        else if( isDense() )
+          desc += " dense";
+        return desc;
+      }
+
+      virtual bool countPostings( uint64_t &decoded, uint64_t &skipped ) const
+      {
+        decoded += pDecoded;
+        if( pDataLoader )
+        {
+          decoded += pDataLoader->getReader().getDecoded();
+          skipped += pDataLoader->getReader().getSkipped();
+        }
+        return true;
+      }
+
+    protected:
+      std::string                 pTerm;
+      TermPostings                pPostings;
+      PostingStatistics           pStats;
+      std::unique_ptr<DataLoader> pDataLoader;
+      uint64_t                    pDecoded = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  // Match a term against a pattern where "*" stands for any sequence of
+  // characters and "?" for any single character
+  //----------------------------------------------------------------------------
+  bool matchPattern( std::string_view pattern, std::string_view term )
+  {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, mark = 0;
+    while( t < term.size() )
+    {
+      if( p < pattern.size() && (pattern[p] == '?' || pattern[p] == term[t]) )
+      {
+        ++p; ++t;
+      }
+      else if( p < pattern.size() && pattern[p] == '*' )
+      {
+        star = p++;
+        mark = t;
+      }
+      else if( star != std::string_view::npos )
+      {
+        p = star + 1;
+        t = ++mark;
+      }
+      else
+        return false;
+    }
+    while( p < pattern.size() && pattern[p] == '*' )
+      ++p;
+    return p == pattern.size();
+  }
+
+  //----------------------------------------------------------------------------
+  //! Expansion node, a single union of the postings of all the terms a
+  //! query word expands to
+  //----------------------------------------------------------------------------
+  class ExpansionNode: public Node
+  {
+    public:
+      ExpansionNode( const std::string &word )
+      {
+        pWord.resize(word.size());
+        std::transform(word.begin(), word.end(), pWord.begin(), tolower);
+      }
+
+      //------------------------------------------------------------------------
+      // Find the terms the word expands to
+      //------------------------------------------------------------------------
+      Status expand( const IndexReader *index, size_t limit )
+      {
+        bool overflow = false;
+        visitTerms( index,
+          [&]( std::string_view, const TermPostings &postings )
+          {
+            if( pTerms.size() == limit )
+            {
+              overflow = true;
+              return false;
+            }
+            pTerms.push_back( postings );
+            pCount += postings.size();
+            return true;
+          } );
+
+        if( overflow )
+          return Status( Status::errLimit, "\"" + pWord + "\" matches " +
+                         "more than " + std::to_string( limit ) + " terms" );
+        return Status();
+      }
+
+      //------------------------------------------------------------------------
+      // Merge the postings into a bitmap if that is cheaper than a heap of
+      // the lists: the bitmap blocks are copied word by word, the rest is
+      // set one id at a time, and the bitmap needs to be cleared and
+      // scanned
+      //------------------------------------------------------------------------
+      virtual void doPrepare( const IndexReader *index )
+      {
+        std::vector<double> counts;
+        double              fillCost = 2*CostModel::words( index );
+        uint64_t            sparse   = 0;
+        for( auto &t: pTerms )
+        {
+          PostingStatistics stats = t.getStatistics();
+          fillCost += stats.denseBytes/8.0 + (stats.documents - stats.dense);
+          sparse   += stats.documents - stats.dense;
+          counts.push_back( stats.documents );
+        }
+        double heapCost = CostModel::heap( pCount, pTerms.size() );
+
+        if( pTerms.size() > 1 && fillCost < heapCost )
+        {
+          pBitmap.reset( newBitmap( index ) );
+          for( auto &t: pTerms )
+            t.fill( *pBitmap );
+          pDecoded = sparse;
+          pCount   = pBitmap->count();
+          pCost  = pBitmap->numWords();
+          return;
+        }
+
+        pCount = std::min( pCount, CostModel::unionCount( index, counts ) );
+        pCost  = heapCost;
+
+        for( auto &t: pTerms )
+        {
+          pLoaders.emplace_back( new DataLoader( t ) );
+          pLoaders.back()->loadResult();
+          pUnion.add( pLoaders.back().get() );
+        }
+        pUnion.build();
+      }
+
+      virtual docid_t getResult() const
+      {
+        return pDoc;
+      }
+
+      virtual bool doLoadResult()
+      {
+        if( pBitmap )
+          return loadFromBitmap( pDoc );
+        return pUnion.next( pDoc );
+      }
+
+      //------------------------------------------------------------------------
+      // Skip the lists behind the target, sifting each one down the heap;
+      // the lists already at or past it are not touched
+      //------------------------------------------------------------------------
+      virtual bool doAdvance( docid_t target )
+      {
+        if( pBitmap )
+          return advanceInBitmap( pDoc, target );
+        if( pDoc != (docid_t)-1 && pDoc >= target )
+          return true;
+        return pUnion.advance( target, pDoc );
+      }
+
+      virtual bool isDense() const { return (bool)pBitmap; }
+
+      virtual void doFill( Bitmap &bitmap )
+      {
+        if( pBitmap )
+          bitmap.orWith( *pBitmap );
+        else
+          Node::doFill( bitmap );
+      }
+
+      virtual std::string describe() const
+      {
+        return std::string( getName() ) + " \"" + pWord + "\" terms=" +
+               std::to_string( pTerms.size() ) +
+               (pBitmap ? " plan=bitmap" : " plan=heap");
+      }
+
+      virtual bool countPostings( uint64_t &decoded, uint64_t &skipped ) const
+      {
+        decoded += pDecoded;
+        for( auto &l: pLoaders )
+        {
+          decoded += l->getReader().getDecoded();
+          skipped += l->getReader().getSkipped();
+        }
+        return true;
+      }
+
+    protected:
+      //------------------------------------------------------------------------
+      // Visit the terms the word expands to
+      //------------------------------------------------------------------------
+      virtual void visitTerms( const IndexReader                *index,
+                               const IndexReader::TermVisitor   &visitor ) = 0;
+
+      //------------------------------------------------------------------------
+      // Name of the operator
+      //------------------------------------------------------------------------
+      virtual const char *getName() const = 0;
+
+      std::string pWord;
+
+    private:
+      std::vector<TermPostings>                pTerms;
+      std::vector<std::unique_ptr<DataLoader>> pLoaders;
+      Union<DataLoader>                        pUnion;
+      docid_t                                  pDoc     = (docid_t)-1;
+      uint64_t                                 pDecoded = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Pattern node, the terms matching a pattern with wildcards
+  //----------------------------------------------------------------------------
+  class PatternNode: public ExpansionNode
+  {
+    public:
+      PatternNode( const std::string &pattern ): ExpansionNode( pattern ) {}
+
+    protected:
+      //------------------------------------------------------------------------
+      // Only the part of the dictionary starting with the literal prefix
+      // of the pattern is scanned
+      //------------------------------------------------------------------------
+      virtual void visitTerms( const IndexReader              *index,
+                               const IndexReader::TermVisitor &visitor )
+      {
+        std::string_view prefix( pWord );
+        prefix = prefix.substr( 0, prefix.find_first_of( "*?" ) );
+        index->visitTerms( prefix,
+          [&]( std::string_view term, const TermPostings &postings )
+          {
+            if( !matchPattern( pWord, term ) )
+              return true;
+            return visitor( term, postings );
+          } );
+      }
+
+      virtual const char *getName() const { return "PATTERN"; }
+  };
+
+  //----------------------------------------------------------------------------
+  //! Fuzzy node, the terms within an edit distance from a term written
+  //! as "term~distance"
+  //----------------------------------------------------------------------------
+  class FuzzyNode: public ExpansionNode
+  {
+    public:
+      FuzzyNode( const std::string &word ): ExpansionNode( word )
+      {
+        size_t tilde = pWord.rfind( '~' );
+        pTerm = pWord.substr( 0, tilde );
+        if( tilde+1 < pWord.size() )
+          pDistance = std::stoul( pWord.substr( tilde+1 ) );
+      }
+
+    protected:
+      virtual void visitTerms( const IndexReader              *index,
+                               const IndexReader::TermVisitor &visitor )
+      {
+        index->visitSimilarTerms( pTerm, pDistance, visitor );
+      }
+
+      virtual const char *getName() const { return "FUZZY"; }
+
+    private:
+      std::string pTerm;
+      uint32_t    pDistance = LevenshteinAutomaton::MaxDistance;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Negate node, the complement of the child within the documents in use
+  //----------------------------------------------------------------------------
+  class NotNode: public Node
+  {
+    public:
+      void setChild( Node *n ) { pChild.reset(n); };
+      Node *getChild() { return pChild.get(); };
+      virtual void doPrepare( const IndexReader *index )
+      {
+        pChild->prepare( index );
+        uint64_t numDocs = index->numDocuments();
+        pCount = numDocs > pChild->getCount() ? numDocs-pChild->getCount() : 0;
+
+        //----------------------------------------------------------------------
+        // The ids in use usually form a single range, otherwise they are
+        // marked in a bitmap
+        //----------------------------------------------------------------------
+        pNext = index->nextDocument( 0 );
+        pEnd  = index->maxDocId()+1;
+        if( !pNext )
+          pNext = pEnd;
+        if( numDocs != pEnd-pNext )
+        {
+          pLive.reset( newBitmap( index ) );
+          index->fillDocuments( *pLive );
+        }
+
+        //----------------------------------------------------------------------
+        // Complement the child word by word if filling a bitmap with it
+        // costs less than walking the ids, which comes close to the number
+        // of the results. Either way, nothing is done until the results
+        // are asked for, because the and-node may rather use the child as
+        // a negator.
+        //----------------------------------------------------------------------
+        pIndex = index;
+        double words  = CostModel::words( index );
+        double walk   = pCount + pChild->getCost();
+        double bitmap = pChild->getFillCost() + (pLive ? 4 : 3)*words;
+        pDense = bitmap < walk;
+        pCost  = std::min( walk, bitmap );
+      }
+
+      virtual double getFillCost() const
+      {
+        if( pDense && !pBitmap )
+          return pCost + CostModel::words( pIndex );
+        return Node::getFillCost();
+      }
+
+      virtual const Bitmap *getBitmap()
+      {
+        materialize();
+        return pBitmap.get();
+      }
+
+      virtual docid_t getResult() const
+      {
+        return pDoc;
+      }
+
+      //------------------------------------------------------------------------
+      // Walk the ids in use skipping the postings of the child, the ids
+      // between two postings come out without touching the child
+      //------------------------------------------------------------------------
+      virtual bool doLoadResult()
+      {
+        materialize();
+        if( pBitmap )
+          return loadFromBitmap( pDoc );
+
+        for( docid_t id = pNext; ; ++id )
+        {
+          if( pLive )
+            id = std::min<uint64_t>( pLive->next( id ), pEnd );
+          if( id >= pEnd )
+            break;
+
+          if( !pChild->advance( id ) || pChild->getResult() != id )
+          {
+            pDoc  = id;
+            pNext = id+1;
+            return true;
+          }
+        }
+
+        pDoc  = (docid_t)-1;
+        pNext = pEnd;
+        return false;
+      }
+
+      virtual bool doAdvance( docid_t target )
+      {
+        materialize();
+        if( pBitmap )
+          return advanceInBitmap( pDoc, target );
+        if( pDoc != (docid_t)-1 && pDoc >= target )
+          return true;
+        pNext = std::max( pNext, target );
+        return doLoadResult();
+      }
+
+      virtual bool isDense() const { return pDense; }
+
+      virtual void doFill( Bitmap &bitmap )
+      {
+        materialize();
+        if( pBitmap )
+          bitmap.orWith( *pBitmap );
+        else
+          Node::doFill( bitmap );
+      }
+
+      virtual std::string describe() const
+      {
+        if( pSubtracted )
+          return "NOT plan=subtract";
+        return pDense ? "NOT plan=complement" : "NOT plan=walk";
+      }
+
+      //------------------------------------------------------------------------
+      // The parent subtracts the child rather than using the complement
+      //------------------------------------------------------------------------
+      void setSubtracted()
+      {
+        pSubtracted = true;
+      }
+
+      virtual void getChildren( std::vector<Node*> &children )
+      {
+        children.push_back( pChild.get() );
+      }
+
+    protected:
+      //------------------------------------------------------------------------
+      // Build the complement if it has been planned and not built yet
+      //------------------------------------------------------------------------
+      void materialize()
+      {
+        if( !pDense || pBitmap )
+          return;
+        pBitmap.reset( newBitmap( pIndex ) );
+        pChild->fill( *pBitmap );
+        pBitmap->flip( pNext, pEnd );
+        if( pLive )
+          pBitmap->andWith( *pLive );
+        pLive.reset();
+        pCount = pBitmap->count();
+        pCost  = pBitmap->numWords();
+      }
+
+      std::unique_ptr<Node>   pChild;
+      std::unique_ptr<Bitmap> pLive;
+      const IndexReader      *pIndex      = 0;
+      docid_t                 pDoc        = (docid_t)-1;
+      docid_t                 pNext       = 0;
+      docid_t                 pEnd        = 0;
+      bool                    pDense      = false;
+      bool                    pSubtracted = false;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Composite node
+  //----------------------------------------------------------------------------
+  class CompositeNode: public Node
+  {
+    public:
+      void addChild( Node *child ) { pNodes.emplace_back(child); }
+
+      virtual bool isDense() const { return (bool)pBitmap; }
+
+      virtual void doFill( Bitmap &bitmap )
+      {
+        if( pBitmap )
+          bitmap.orWith( *pBitmap );
+        else
+          Node::doFill( bitmap );
+      }
+
+      virtual void getChildren( std::vector<Node*> &children )
+      {
+        for( auto &n: pNodes )
+          children.push_back( n.get() );
+      }
+
+    protected:
+      std::vector<std::unique_ptr<Node>> pNodes;
+  };
+
+  //----------------------------------------------------------------------------
+  //! And node
+  //----------------------------------------------------------------------------
+  class AndNode: public CompositeNode
+  {
+    public:
+      //------------------------------------------------------------------------
+      // Prepare the query for optimal execution: estimate the costs of
+      // intersecting the bitmaps of all the children and of driving from
+      // the child with the fewest results, probing the others, and pick
+      // the cheaper plan
+      //------------------------------------------------------------------------
+      virtual void doPrepare( const IndexReader *index )
+      {
+        for( auto &n: pNodes )
+          n->prepare( index );
+        std::sort(pNodes.begin(), pNodes.end(),
+                  [](auto &n1, auto &n2)
+                    { return n1->getCount() < n2->getCount(); } );
+        pCount = estimateCount( index );
+
+        //----------------------------------------------------------------------
+        // Drive from the child with the fewest results, a negated one too
+        // if its complement is that small. A negated child is subtracted,
+        // probing its operand with every candidate, unless building its
+        // complement and probing that is cheaper. If the next child is of
+        // comparable length, the terms are decoded, or copied to a bitmap
+        // if they are dense, and intersected as arrays instead, see
+        // prepareList. Every child narrows down the candidates to probe
+        // the next one with.
+        //----------------------------------------------------------------------
+        double             words    = CostModel::words( index );
+        double             bitmap   = words;
+        bool               positive = false;
+        std::vector<Node*> intersectors;
+        std::vector<NotNode*> negators;
+        pFirst = pNodes[0].get();
+        pCost  = pFirst->getCost();
+        double drive = pFirst->getCount();
+        bool   list  = dynamic_cast<TermNode*>(pFirst);
+        for( auto &n: pNodes )
+        {
+          Node    *node    = n.get();
+          NotNode *notNode = dynamic_cast<NotNode*>(node);
+          if( notNode )
+            bitmap += notNode->getChild()->getFillCost() + 2*words;
+          else
+          {
+            bitmap  += node->getFillCost() + 2*words;
+            positive = true;
+          }
+          if( node == pFirst )
+            continue;
+
+          double probe = CostModel::skip( drive, node->getCount() );
+          if( notNode )
+          {
+            double subtract = CostModel::skip( drive,
+                                               notNode->getChild()->getCount() );
+            if( !notNode->isDense() ||
+                subtract <= notNode->getFillCost() + drive )
+            {
+              negators.push_back(notNode);
+              pCost += subtract;
+              continue;
+            }
+            probe = notNode->getFillCost() + drive;
+          }
+          if( intersectors.empty() )
+            list = list && node->getCount() <= ListRatio*drive &&
+                   (notNode || dynamic_cast<TermNode*>(node));
+          if( list && !notNode && dynamic_cast<TermNode*>(node) )
+          {
+            if( node->isDense() )
+              probe = node->getFillCost() + words + drive;
+            else if( node->getCount() <= ListRatio*drive )
+              probe = node->getCount() + drive;
+          }
+          intersectors.push_back(node);
+          pCost += probe;
+          drive *= node->getCount()/CostModel::documents( index );
+        }
+
+        if( positive && bitmap < pCost )
+        {
+          prepareBitmap( index );
+          return;
+        }
+
+        for( auto node: negators )
+        {
+          node->setSubtracted();
+          pNegators.addNode(node->getChild());
+        }
+        if( list && !intersectors.empty() )
+        {
+          prepareList( index, intersectors );
+          return;
+        }
+        for( auto node: intersectors )
+          pIntersectors.addNode(node);
+      }
+
+      //------------------------------------------------------------------------
+      // Estimate the number of results, the children are sorted; the two
+      // smallest terms compare their blocks, the rest are independent
+      //------------------------------------------------------------------------
+      uint64_t estimateCount( const IndexReader *index ) const
+      {
+        double    n       = CostModel::documents( index );
+        double    count   = n;
+        TermNode *pair[2] = { 0, 0 };
+        for( auto &node: pNodes )
+        {
+          TermNode *term = dynamic_cast<TermNode*>(node.get());
+          if( term && !pair[1] )
+            pair[pair[0] ? 1 : 0] = term;
+          else
+            count *= node->getCount()/n;
+        }
+        if( pair[1] )
+          count *= pair[0]->estimateIntersection( *pair[1] )/n;
+        else if( pair[0] )
+          count *= pair[0]->getCount()/n;
+        return std::min<uint64_t>( count+0.5, pNodes[0]->getCount() );
+      }
+
+      //------------------------------------------------------------------------
+      // If the two shortest lists are of similar size, skipping does not
+      // save much; decode the shortest one and intersect it with the others
+      // as arrays, with the kernel suited to the lengths. The dense terms
+      // are copied to a bitmap and probed instead of being decoded. The
+      // children that are much longer than the intermediate result, or
+      // that cannot be decoded, are probed with advance. Only called when
+      // doPrepare has costed this plan, the first child is then a term.
+      //------------------------------------------------------------------------
+      void prepareList( const IndexReader         *index,
+                        const std::vector<Node*>  &positive )
+      {
+        static_cast<TermNode*>(pFirst)->collect( pList );
+        std::vector<docid_t> ids;
+        for( auto node: positive )
+        {
+          size_t    size = 0;
+          TermNode *term = dynamic_cast<TermNode*>(node);
+          if( pList.empty() )
+            break;
+          else if( node->getBitmap() )
+            size = IntersectionKernels::filter( pList.data(), pList.size(),
+                                                *node->getBitmap(),
+                                                pList.data() );
+          else if( term && term->isDense() )
+          {
+            std::unique_ptr<Bitmap> bitmap( newBitmap( index ) );
+            term->fill( *bitmap );
+            size = IntersectionKernels::filter( pList.data(), pList.size(),
+                                                *bitmap, pList.data() );
+          }
+          else if( term && term->getCount() <= ListRatio*pList.size() )
+          {
+            term->collect( ids );
+            size = IntersectionKernels::intersect( pList.data(), pList.size(),
+                                                   ids.data(), ids.size(),
+                                                   pList.data() );
+          }
+          else
+          {
+            for( auto id: pList )
+              if( node->advance( id ) && node->getResult() == id )
+                pList[size++] = id;
+          }
+          pList.resize( size );
+        }
+        pCount = pList.size();
+        pListMode = true;
+      }
+
+      //------------------------------------------------------------------------
+      // Intersect the bitmaps of the children word by word and subtract
+      // the ones of the operands of the negated children, the first
+      // positive child starts the result
+      //------------------------------------------------------------------------
+      void prepareBitmap( const IndexReader *index )
+      {
+        std::stable_sort(pNodes.begin(), pNodes.end(),
+                  [](auto &n1, auto &n2)
+                    {
+                      return !dynamic_cast<NotNode*>(n1.get()) &&
+                              dynamic_cast<NotNode*>(n2.get());
+                    } );
+
+        for( auto &n: pNodes )
+        {
+          NotNode *notNode = dynamic_cast<NotNode*>(n.get());
+          Node    *node    = notNode ? notNode->getChild() : n.get();
+          if( notNode )
+            notNode->setSubtracted();
+          if( !pBitmap )
+          {
+            pBitmap.reset( newBitmap( index ) );
+            node->fill( *pBitmap );
+            continue;
+          }
+
+          std::unique_ptr<Bitmap> bitmap( newBitmap( index ) );
+          node->fill( *bitmap );
+          if( notNode )
+            pBitmap->andNotWith( *bitmap );
+          else
+            pBitmap->andWith( *bitmap );
+        }
+        pCount = pBitmap->count();
+        pCost  = pBitmap->numWords();
+      }
+
+      virtual docid_t getResult() const
+      {
+        return pDoc;
+      }
+
+      //------------------------------------------------------------------------
+      // The negators are the operands of the negated children checked for
+      // every candidate rather than iterated
+      //------------------------------------------------------------------------
+      virtual std::string describe() const
+      {
+        std::string desc = "AND plan=";
+        if( pBitmap )
+          return desc + "bitmap";
+        desc += pListMode ? "list" : "leapfrog";
+        if( pNegators.size() )
+          desc += " negators=" + std::to_string( pNegators.size() );
+        return desc;
+      }
+
+      virtual bool doLoadResult()
+      {
+        if( pBitmap )
+          return loadFromBitmap( pDoc );
+        if( pListMode )
+          return loadFromList();
+
+        return search(pFirst->loadResult());
+      }
+
+      //------------------------------------------------------------------------
+      //! Skip the first node to the target and search from there
+      //------------------------------------------------------------------------
+      virtual bool doAdvance( docid_t target )
+      {
+        if( pBitmap )
+          return advanceInBitmap( pDoc, target );
+        if( pDoc != (docid_t)-1 && pDoc >= target )
+          return true;
+        if( pListMode )
+        {
+          pListPos = std::lower_bound( pList.begin()+pListPos, pList.end(),
+                                       target ) - pList.begin();
+          return loadFromList();
+        }
+        return search(pFirst->advance(target));
+      }
+    private:
+      static const uint64_t ListRatio = 16;
+
+      //------------------------------------------------------------------------
+      // Take the next id of the intersected list that none of the negators
+      // has
+      //------------------------------------------------------------------------
+      bool loadFromList()
+      {
+        while( pListPos < pList.size() )
+        {
+          docid_t doc = pList[pListPos++];
+          if( !pNegators.check(doc) )
+          {
+            pDoc = doc;
+            return true;
+          }
+        }
+        pDoc = (docid_t)-1;
+        return false;
+      }
+
+      //------------------------------------------------------------------------
+      // Starting from the current result of the first node, leapfrog the
+      // intersectors until they agree on a document that none of the
+      // negators has
+      //------------------------------------------------------------------------
+      bool search(bool found)
+      {
+        while(found)
         {
-          while(n->getResult() < docId && n->loadResult());
-          if(n->getResult() == docId)
+          docid_t doc     = pFirst->getResult();
+          docid_t aligned = pIntersectors.align(doc);
+          if(aligned == (docid_t)-1)
+            break;
+          if(aligned != doc)
+            found = pFirst->advance(aligned);
+          else if(pNegators.check(doc))
+            found = pFirst->loadResult();
+          else
+          {
+            pDoc = doc;
             return true;
+          }
         }
+        pDoc = (docid_t)-1;
         return false;
       }
-      void addNode(Node *n) { pNodes.push_back(n); }
-      void loadNodes() { for(auto n: pNodes) n->loadResult(); }
-    private:
-      std::vector<Node*> pNodes;
+
+      docid_t               pDoc      = (docid_t)-1;
+      Node                 *pFirst    = 0;
+      Sum                   pNegators;
+      Intersection          pIntersectors;
+      std::vector<docid_t>  pList;
+      size_t                pListPos  = 0;
+      bool                  pListMode = false;
   };
 
   //----------------------------------------------------------------------------
-  //! Term node
+  //! Or node
   //----------------------------------------------------------------------------
-  class TermNode: public Node
+  class OrNode: public CompositeNode
   {
     public:
-      TermNode( const std::string &term )
+      virtual void doPrepare( const IndexReader *index )
       {
-        pTerm.resize(term.size());
-        std::transform(term.begin(), term.end(), pTerm.begin(), tolower);
-      }
-
-      virtual void prepare( const Index *index )
-      {
-        auto it = index->find( pTerm );
-        if( it != index->termsEnd() )
+        for( auto &n: pNodes )
+          n->prepare( index );
+        std::vector<double> counts;
+        double              total    = 0;
+        double              heapCost = 0;
+        double              fillCost = 2*CostModel::words( index );
+        for( auto &n: pNodes )
         {
-          pCount    =  it->second.numPostings();
-          pDataLoader.reset( new DataLoader(&it->second.getPostings()) );
+          counts.push_back( n->getCount() );
+          total    += n->getCount();
+          heapCost += n->getCost();
+          fillCost += n->getFillCost();
         }
-      }
-
-      virtual docid_t getResult() const { return pDataLoader->getResult(); }
-      virtual bool loadResult() { return pDataLoader->loadResult(); };
+        heapCost += CostModel::heap( total, pNodes.size() );
 
-    protected:
-      std::string                 pTerm;
-      std::unique_ptr<DataLoader> pDataLoader;
-  };
+        //----------------------------------------------------------------------
+        // Accumulate the children in a bitmap if that is cheaper than a heap
+        // of them: the dense ones are summed word by word and the union may
+        // be dense enough for the scan of the bitmap to pay off
+        //----------------------------------------------------------------------
+        if( fillCost < heapCost )
+        {
+          pBitmap.reset( newBitmap( index ) );
+          for( auto &n: pNodes )
+            n->fill( *pBitmap );
+          pCount = pBitmap->count();
+          pCost  = pBitmap->numWords();
+          return;
+        }
 
-  //----------------------------------------------------------------------------
-  //! Negate node
-  //----------------------------------------------------------------------------
-  class NotNode: public Node
-  {
-    public:
-      void setChild( Node *n ) { pChild.reset(n); };
-      Node *getChild() { return pChild.get(); };
-      virtual void prepare( const Index *index )
-      {
-        pChild->prepare( index );
-        pCount = index->numDocuments() - pChild->getCount();
-        pIndex = index;
-        pCurrent = pIndex->documentsBegin();
-        ++pCurrent; // skip the dummy index
-        pSum.addNode(pChild.get());
-        pSum.loadNodes();
-       }
+        pCount = CostModel::unionCount( index, counts );
+        pCost  = heapCost;
+        for( auto &n: pNodes )
+        {
+          n->loadResult();
+          pUnion.add( n.get() );
+        }
+        pUnion.build();
+      }
 
       virtual docid_t getResult() const
       {
         return pDoc;
       }
 
-      virtual bool loadResult()
+      //------------------------------------------------------------------------
+      //! Skip the children behind the target and load the smallest result
+      //------------------------------------------------------------------------
+      virtual bool doAdvance( docid_t target )
       {
-        while(pCurrent != pIndex->documentsEnd())
-        {
-          pDoc = pCurrent->first;
-          ++pCurrent;
-          if(pSum.check(pDoc))
-            continue;
+        if( pBitmap )
+          return advanceInBitmap( pDoc, target );
+        if( pDoc != (docid_t)-1 && pDoc >= target )
           return true;
-        }
+        return pUnion.advance( target, pDoc );
+      }
 
-        return false;
+      //------------------------------------------------------------------------
+      //! Load a result
+      //------------------------------------------------------------------------
+      virtual bool doLoadResult()
+      {
+        if( pBitmap )
+          return loadFromBitmap( pDoc );
+        return pUnion.next( pDoc );
       }
 
-    protected:
-      std::unique_ptr<Node>         pChild;
-      docid_t                       pDoc     = (docid_t)-1;
-      Index::DocMap::const_iterator pCurrent;
-      const Index                  *pIndex   = 0;
-      Sum                           pSum;
+      virtual std::string describe() const
+      {
+        return pBitmap ? "OR plan=bitmap" : "OR plan=heap";
+      }
+    private:
+      Union<Node> pUnion;
+      docid_t     pDoc = (docid_t)-1;
   };
 
   //----------------------------------------------------------------------------
-  //! Composite node
+  //! Filter node, the documents of a sub-tree taken from the filter cache,
+  //! or materialized from the sub-tree and stored there
   //----------------------------------------------------------------------------
-  class CompositeNode: public Node
+  class FilterNode: public Node
   {
     public:
-      void addChild( Node *child ) { pNodes.emplace_back(child); }
-    protected:
-      std::vector<std::unique_ptr<Node>> pNodes;
-  };
+      FilterNode( const std::string &key, std::shared_ptr<const Bitmap> docs ):
+        pKey( key ), pDocs( std::move( docs ) ) {}
+
+      FilterNode( const std::string &key, Node *child, FilterCache *cache ):
+        pKey( key ), pChild( child ), pCache( cache ) {}
 
-  //----------------------------------------------------------------------------
-  //! And node
-  //----------------------------------------------------------------------------
-  class AndNode: public CompositeNode
-  {
-    public:
       //------------------------------------------------------------------------
-      // Prepare the query for optimal execution
+      // The sub-tree is planned and, unless it costs less than a scan of a
+      // bitmap, filled into one right away; the cost is paid once for the
+      // queries that reuse it. A cheap sub-tree is run as it is and passed
+      // over by the cache from then on.
       //------------------------------------------------------------------------
-      virtual void prepare( const Index *index )
+      virtual void doPrepare( const IndexReader *index )
       {
-        for( auto &n: pNodes )
-          n->prepare( index );
-        std::sort(pNodes.begin(), pNodes.end(),
-                  [](auto &n1, auto &n2)
-                    { return n1->getCount() < n2->getCount(); } );
-        pCount = pNodes[0]->getCount();
-
-        //----------------------------------------------------------------------
-        // Find first node that is not a NotNode to use as a first source
-        // of documents, if there is no such node just use the first node
-        //----------------------------------------------------------------------
-        for( auto &n: pNodes )
+        if( !pDocs )
         {
-          NotNode *notNode = dynamic_cast<NotNode*>(n.get());
-          if(!notNode)
+          pChild->prepare( index );
+          if( pChild->getCost() < CostModel::words( index ) )
           {
-            pFirst = n.get();
-            break;
+            pCache->passOver( pKey, index->getVersion() );
+            pCount = pChild->getCount();
+            pCost  = pChild->getCost();
+            return;
           }
+          Bitmap *docs = newBitmap( index );
+          pChild->fill( *docs );
+          pDocs.reset( docs );
+          pCache->insert( pKey, pDocs, index->getVersion() );
         }
-        if(!pFirst)
-          pFirst = pNodes[0].get();
+        pCount = pDocs->count();
+        pCost  = pDocs->numWords();
+      }
 
-        //----------------------------------------------------------------------
-        // Use not nodes as negators and normal nodes as intersectors
-        //----------------------------------------------------------------------
-        for( auto &n: pNodes )
-        {
-          Node *node = n.get();
-          if( node == pFirst )
-            continue;
+      virtual docid_t getResult() const
+      {
+        if( !pDocs )
+          return pChild->getResult();
+        return pDoc;
+      }
 
-          NotNode *notNode = dynamic_cast<NotNode*>(node);
-          if(notNode)
-            pNegators.addNode(notNode->getChild());
-          else
-            pIntersectors.addNode(node);
-        }
+      virtual bool doLoadResult()
+      {
+        if( !pDocs )
+          return pChild->loadResult();
+        return loadFromBitmap( pDoc, *pDocs );
+      }
 
-        //----------------------------------------------------------------------
-        // Load data to intersectors but not no negators, because these have
-        // been loaded by the not-node's prepare already
-        //----------------------------------------------------------------------
-        pIntersectors.loadNodes();
+      virtual bool doAdvance( docid_t target )
+      {
+        if( !pDocs )
+          return pChild->advance( target );
+        return advanceInBitmap( pDoc, target, *pDocs );
       }
 
-      virtual docid_t getResult() const
+      virtual bool isDense() const
       {
-        return pDoc;
+        return pDocs || pChild->isDense();
       }
 
-      virtual bool loadResult()
+      virtual void doFill( Bitmap &bitmap )
       {
-        while(pFirst->loadResult())
-        {
-          pDoc = pFirst->getResult();
-          if(pIntersectors.check(pDoc))
-          {
-            if(pNegators.check(pDoc))
-              continue;
-            return true;
-          }
-        }
-        return false;
+        if( !pDocs )
+          pChild->fill( bitmap );
+        else
+          bitmap.orWith( *pDocs );
+      }
+
+      virtual double getFillCost() const
+      {
+        return pDocs ? pDocs->numWords() : pChild->getFillCost();
+      }
+
+      virtual const Bitmap *getBitmap()
+      {
+        return pDocs ? pDocs.get() : pChild->getBitmap();
+      }
+
+      virtual std::string describe() const
+      {
+        std::string plan = " plan=cached";
+        if( pChild )
+          plan = pDocs ? " plan=materialize" : " plan=passthrough";
+        return "FILTER \"" + pKey + "\"" + plan;
+      }
+
+      virtual void getChildren( std::vector<Node*> &children )
+      {
+        if( pChild )
+          children.push_back( pChild.get() );
       }
+
     private:
-      docid_t       pDoc;
-      Node         *pFirst;
-      Sum           pNegators;
-      Intersection  pIntersectors;
+      std::string                   pKey;
+      std::shared_ptr<const Bitmap> pDocs;
+      std::unique_ptr<Node>         pChild;
+      FilterCache                  *pCache = 0;
+      docid_t                       pDoc   = (docid_t)-1;
   };
 
   //----------------------------------------------------------------------------
-  //! Or node
+  //! Parameters of the translation of a parse tree
   //----------------------------------------------------------------------------
-  class OrNode: public CompositeNode
+  struct TranslateContext
   {
-    public:
-      virtual void prepare( const Index *index )
-      {
-        for( auto &n: pNodes )
-          n->prepare( index );
-        pCount = 0;
-        for( auto &n: pNodes )
-        {
-          pCount += n->getCount();
-          n->loadResult();
-        }
-        std::sort(pNodes.begin(), pNodes.end(),
-                  [](auto &n1, auto &n2)
-                    {
-                      NotNode *no1 = dynamic_cast<NotNode*>(n1.get());
-                      NotNode *no2 = dynamic_cast<NotNode*>(n2.get());
-                      if( no1 == no2 )
-                        return n1->getCount() < n2->getCount();
-                      return no1 < no2;
-                    } );
-      }
+    const IndexReader *index;
+    size_t             expansionLimit;
+    FilterCache       *filters;
+    bool               record;
+    Status             status;
+  };
 
-      virtual docid_t getResult() const
-      {
-        return pDoc;
-      }
+  Node *translate( QueryParser::Node *node, TranslateContext &ctx,
+                   bool root = false );
 
-      //------------------------------------------------------------------------
-      //! Load a result
-      //------------------------------------------------------------------------
-      virtual bool loadResult()
+  //----------------------------------------------------------------------------
+  // Translate the operands of an operator but the skipped one
+  //----------------------------------------------------------------------------
+  CompositeNode *translateOperator( QueryParser::Node *node,
+                                    TranslateContext  &ctx,
+                                    size_t             skip = (size_t)-1 )
+  {
+    CompositeNode *n;
+    if( node->getToken() == "OR" )
+      n = new OrNode();
+    else
+      n = new AndNode();
+    auto &children = node->getChildren();
+    for( size_t i = 0; i < children.size(); ++i )
+      if( i != skip )
+        n->addChild(translate(children[i], ctx));
+    return n;
+  }
+
+  //----------------------------------------------------------------------------
+  // Use the filter cache for an operator: the candidates are the operator
+  // itself, unless it is the root, and the subsets of all its operands
+  // but one, whose keys are written the way QueryRewriter::toString would
+  // write them, the operands being sorted. A cached candidate becomes a
+  // leaf, otherwise the candidates are recorded, unless the context says
+  // not to, and the first one run often enough is materialized, or run as
+  // it is if it turns out cheap, see FilterNode. Null is returned if
+  // neither happens.
+  //----------------------------------------------------------------------------
+  Node *translateFilter( QueryParser::Node *node,
+                         TranslateContext  &ctx,
+                         bool               root )
+  {
+    auto   &children = node->getChildren();
+    size_t  size     = children.size();
+    std::vector<std::pair<std::string, size_t>> keys;
+    if( !root )
+      keys.emplace_back( QueryRewriter::toString( node ), (size_t)-1 );
+    if( size >= 3 && size <= QueryExecutor::MaxFilterOperands )
+    {
+      std::vector<std::string> operands;
+      for( auto c: children )
+        operands.push_back( QueryRewriter::toString( c ) );
+      for( size_t skip = 0; skip < size; ++skip )
       {
-        pDoc = (docid_t)-1;
-        for( auto &n: pNodes )
+        std::string key = "(";
+        for( size_t i = 0; i < size; ++i )
         {
-          if(n->getResult() == (docid_t)-1)
+          if( i == skip )
             continue;
-          if(pDoc > n->getResult())
-            pDoc = n->getResult();
+          if( key.size() > 1 )
+            key += " " + node->getToken() + " ";
+          key += operands[i];
         }
+        keys.emplace_back( key + ")", skip );
+      }
+    }
 
-        if(pDoc == (docid_t)-1)
-          return false;
+    //--------------------------------------------------------------------------
+    // Combine the filter with the operand it leaves out, if any
+    //--------------------------------------------------------------------------
+    auto combine = [&]( Node *filter, size_t skip ) -> Node *
+    {
+      if( skip == (size_t)-1 )
+        return filter;
+      CompositeNode *n;
+      if( node->getToken() == "OR" )
+        n = new OrNode();
+      else
+        n = new AndNode();
+      n->addChild(filter);
+      n->addChild(translate(children[skip], ctx));
+      return n;
+    };
 
-        for( auto &n: pNodes )
-          if(pDoc == n->getResult())
-            n->loadResult();
+    uint64_t version = ctx.index->getVersion();
+    for( auto &k: keys )
+    {
+      std::shared_ptr<const Bitmap> docs = ctx.filters->find( k.first,
+                                                               version );
+      if( docs )
+        return combine( new FilterNode( k.first, std::move( docs ) ),
+                        k.second );
+    }
 
-        return true;
-      }
-    private:
-      docid_t pDoc = (docid_t)-1;
-  };
+    if( !ctx.record )
+      return nullptr;
+
+    const std::pair<std::string, size_t> *admitted = 0;
+    for( auto &k: keys )
+      if( ctx.filters->record( k.first, version ) && !admitted )
+        admitted = &k;
+    if( !admitted )
+      return nullptr;
+
+    Node *sub = translateOperator( node, ctx, admitted->second );
+    return combine( new FilterNode( admitted->first, sub, ctx.filters ),
+                    admitted->second );
+  }
 
   //----------------------------------------------------------------------------
-  // Translate the parse tree to the execution tree
+  // Translate the parse tree to the execution tree, the patterns are
+  // expanded on the way and the operators looked up in the filter cache
   //----------------------------------------------------------------------------
-  Node *translate( Librarian::QueryParser::Node *node )
+  Node *translate( QueryParser::Node *node, TranslateContext &ctx, bool root )
   {
     using namespace Librarian;
     if(!node)
@@ -368,28 +1764,137 @@ namespace
     {
       case(QueryLexer::Term):
         return new TermNode(node->getToken());
+      case(QueryLexer::Pattern):
+      case(QueryLexer::Fuzzy):
+      {
+        ExpansionNode *n;
+        if( node->getType() == QueryLexer::Pattern )
+          n = new PatternNode(node->getToken());
+        else
+          n = new FuzzyNode(node->getToken());
+        Status st = n->expand(ctx.index, ctx.expansionLimit);
+        if( !st.isOK() && ctx.status.isOK() )
+          ctx.status = st;
+        return n;
+      }
       case(QueryLexer::UnaryOp):
       {
         NotNode *n = new NotNode();
-        n->setChild(translate(node->getChildren()[0]));
+        if( QueryRewriter::isAll(node) )
+          n->setChild(new EmptyNode());
+        else
+          n->setChild(translate(node->getChildren()[0], ctx));
         return n;
       }
       case(QueryLexer::BinaryOp):
       {
-        CompositeNode *n;
-        if( node->getToken() == "OR" )
-          n = new OrNode();
-        else
-          n = new AndNode();
-        for( auto &ch: node->getChildren() )
-          n->addChild(translate(ch));
-        return n;
+        if( ctx.filters )
+          if( Node *n = translateFilter(node, ctx, root) )
+            return n;
+        return translateOperator(node, ctx);
       }
      default:
        return nullptr;
     }
     return nullptr;
   }
+
+  //----------------------------------------------------------------------------
+  // Parse the query and rewrite it, the tree is null if the query cannot
+  // have any results
+  //----------------------------------------------------------------------------
+  Status parseQuery( QueryParser::Node *&tree,
+                     const std::string  &query,
+                     const IndexReader  *index )
+  {
+    QueryParser parser( query.c_str() );
+    tree = 0;
+    Status st = parser.parse(tree);
+    if( !st.isOK() )
+      return st;
+    tree = QueryRewriter(index).rewrite(tree);
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Translate the rewritten parse tree, which is taken over, to the
+  // execution tree; the filter cache is only looked up, unless record is
+  // set and the sub-trees count towards admission and get materialized
+  //----------------------------------------------------------------------------
+  Status buildTree( Node              *&tree,
+                    QueryParser::Node  *parseTree,
+                    const IndexReader  *index,
+                    size_t              expansionLimit,
+                    FilterCache        *filters,
+                    bool                record )
+  {
+    TranslateContext ctx{ index, expansionLimit, filters, record, Status() };
+    tree = translate(parseTree, ctx, true);
+    delete parseTree;
+    if( !ctx.status.isOK() )
+    {
+      delete tree;
+      tree = 0;
+    }
+    return ctx.status;
+  }
+
+  //----------------------------------------------------------------------------
+  // Collect the counters of all the nodes of the tree
+  //----------------------------------------------------------------------------
+  void enableProfiles( Node *node )
+  {
+    std::vector<Node*> children;
+    node->enableProfile();
+    node->getChildren( children );
+    for( auto child: children )
+      enableProfiles( child );
+  }
+
+  //----------------------------------------------------------------------------
+  // Describe the plan of every node with its estimated number of results
+  // and cost, a line per node indented by its depth
+  //----------------------------------------------------------------------------
+  void describeTree( std::vector<std::string> &lines,
+                     Node                     *node,
+                     size_t                    depth )
+  {
+    std::ostringstream os;
+    os << std::string( 2*depth, ' ' ) << node->describe();
+    os << " est=" << node->getCount();
+    os << " cost=" << std::llround( node->getCost() );
+    lines.push_back( os.str() );
+
+    std::vector<Node*> children;
+    node->getChildren( children );
+    for( auto child: children )
+      describeTree( lines, child, depth+1 );
+  }
+
+  //----------------------------------------------------------------------------
+  // Append the counters collected while running to the lines of the nodes,
+  // the tree is walked in the same order as by describeTree
+  //----------------------------------------------------------------------------
+  void profileTree( std::vector<std::string> &lines,
+                    size_t                   &line,
+                    Node                     *node )
+  {
+    const Profile *prof = node->getProfile();
+    uint64_t decoded = 0, skipped = 0;
+    std::ostringstream os;
+    os << " rows=" << prof->rows << " loads=" << prof->loads;
+    os << " advances=" << prof->advances << " fills=" << prof->fills;
+    if( node->countPostings( decoded, skipped ) )
+      os << " decoded=" << decoded << " skipped=" << skipped;
+    os << " time=" << std::fixed << std::setprecision( 3 ) << prof->time;
+    os << "ms";
+    lines[line++] += os.str();
+
+    std::vector<Node*> children;
+    node->getChildren( children );
+    for( auto child: children )
+      profileTree( lines, line, child );
+  }
 }
 
 namespace Librarian
@@ -400,18 +1905,88 @@ namespace Librarian
   Status QueryExecutor::runQuery( std::deque<std::string> &result,
                                   const std::string       &query )
   {
-    QueryParser parser( query.c_str() );
     QueryParser::Node *parseTree = 0;
-    Status st = parser.parse(parseTree);
+    Status st = parseQuery( parseTree, query, pIndex );
     if( !st.isOK() )
       return st;
-    Node *execTree = translate(parseTree);
-    delete parseTree;
-    execTree->prepare(pIndex);
+
     result.clear();
+    if( !parseTree )
+      return Status();
+
+    //--------------------------------------------------------------------------
+    // The cache is looked up before the patterns are expanded
+    //--------------------------------------------------------------------------
+    std::vector<docid_t> docs;
+    std::string          key;
+    if( pCache )
+    {
+      key = QueryRewriter::toString( parseTree );
+      if( pCache->find( docs, key, pIndex->getVersion() ) )
+      {
+        delete parseTree;
+        for( auto id: docs )
+          result.push_back( std::string( pIndex->getDocumentName( id ) ) );
+        return Status();
+      }
+    }
+
+    Node *execTree = 0;
+    st = buildTree( execTree, parseTree, pIndex, pExpansionLimit,
+                    pFilters.get(), true );
+    if( !st.isOK() )
+      return st;
+
+    execTree->prepare(pIndex);
     while(execTree->loadResult())
-      result.push_back(pIndex->getDocumentName(execTree->getResult()));
+    {
+      if( pCache )
+        docs.push_back( execTree->getResult() );
+      result.push_back(
+        std::string(pIndex->getDocumentName(execTree->getResult())));
+    }
+    delete execTree;
+
+    if( pCache )
+      pCache->insert( key, docs, pIndex->getVersion() );
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Describe the execution plan of a query
+  //----------------------------------------------------------------------------
+  Status QueryExecutor::explain( std::string       &plan,
+                                 const std::string &query,
+                                 bool               analyze )
+  {
+    QueryParser::Node *parseTree = 0;
+    Node              *execTree  = 0;
+    Status st = parseQuery( parseTree, query, pIndex );
+    if( st.isOK() && parseTree )
+      st = buildTree( execTree, parseTree, pIndex, pExpansionLimit,
+                      pFilters.get(), analyze );
+    if( !st.isOK() )
+      return st;
+
+    if( !execTree )
+      execTree = new EmptyNode();
+    if( analyze )
+      enableProfiles( execTree );
+    execTree->prepare(pIndex);
+
+    std::vector<std::string> lines;
+    describeTree( lines, execTree, 0 );
+    if( analyze )
+    {
+      size_t line = 0;
+      while(execTree->loadResult());
+      profileTree( lines, line, execTree );
+    }
     delete execTree;
+
+    plan.clear();
+    for( auto &l: lines )
+      plan += l + "\n";
     return Status();
   }
 };
@@ -21,29 +21,137 @@
 
 #include <string>
 #include <deque>
+#include <memory>
 
 #include <Librarian/Status.hh>
+#include <Librarian/QueryCache.hh>
+#include <Librarian/FilterCache.hh>
 
 namespace Librarian
 {
-  class Index;
+  class IndexReader;
 
   class QueryExecutor
   {
     public:
+      //! Default maximal number of terms a wildcard pattern may expand to
+      static const size_t DefaultExpansionLimit = 10000;
+
+      //! Maximal number of operands of an operator whose subsets are
+      //! considered for the filter cache
+      static const size_t MaxFilterOperands = 8;
+
       //------------------------------------------------------------------------
       //! Constructor
       //------------------------------------------------------------------------
-      QueryExecutor( const Index *index ):
+      QueryExecutor( const IndexReader *index ):
         pIndex( index ) {}
 
+      //------------------------------------------------------------------------
+      //! Set the maximal number of terms a wildcard pattern may expand to,
+      //! queries going over it fail
+      //------------------------------------------------------------------------
+      void setExpansionLimit( size_t limit )
+      {
+        pExpansionLimit = limit;
+        if( pCache )
+          pCache->clear();
+        if( pFilters )
+          pFilters->clear();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the maximal number of terms a wildcard pattern may expand to
+      //------------------------------------------------------------------------
+      size_t getExpansionLimit() const
+      {
+        return pExpansionLimit;
+      }
+
       //------------------------------------------------------------------------
       //! Execute a boolean query
       //------------------------------------------------------------------------
       Status runQuery( std::deque<std::string> &result,
                        const std::string       &query );
 
+      //------------------------------------------------------------------------
+      //! Keep the results of the recent queries in a cache, see QueryCache;
+      //! the queries are looked up after they have been rewritten
+      //!
+      //! @param budget maximal number of bytes the results may take, zero
+      //!               disables the cache
+      //------------------------------------------------------------------------
+      void setCacheBudget( size_t budget )
+      {
+        pCache.reset( budget ? new QueryCache( budget ) : 0 );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the counters of the result cache, all zero if it is disabled
+      //------------------------------------------------------------------------
+      QueryCache::Statistics getCacheStatistics() const
+      {
+        return pCache ? pCache->getStatistics() : QueryCache::Statistics();
+      }
+
+      //------------------------------------------------------------------------
+      //! Keep the documents of the sub-trees the queries share as bitmaps,
+      //! see FilterCache; the cached ones are used as leaves of the later
+      //! plans
+      //!
+      //! The candidates are the operators below the root and, for the
+      //! operators with three to MaxFilterOperands operands, the subsets
+      //! of all their operands but one, since the rewriter flattens a
+      //! shared clause into the operator it is combined with
+      //!
+      //! @param budget    maximal number of bytes the bitmaps may take,
+      //!                  zero disables the cache
+      //! @param admission number of runs within the recent ones after
+      //!                  which a sub-tree is cached
+      //------------------------------------------------------------------------
+      void setFilterCacheBudget(
+        size_t   budget,
+        uint32_t admission = FilterCache::DefaultAdmission )
+      {
+        pFilters.reset( budget ? new FilterCache( budget, admission ) : 0 );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the counters of the filter cache, all zero if it is disabled
+      //------------------------------------------------------------------------
+      FilterCache::Statistics getFilterCacheStatistics() const
+      {
+        return pFilters ? pFilters->getStatistics() :
+                          FilterCache::Statistics();
+      }
+
+      //------------------------------------------------------------------------
+      //! Describe how a boolean query is executed: the rewritten execution
+      //! tree, one operator per line, with its plan and the estimated
+      //! number of results and cost; the cached filters are used, but
+      //! nothing is recorded in or added to the filter cache unless the
+      //! query is analyzed
+      //!
+      //! The plan is picked the way a run picks it, which does part of the
+      //! work of the run: the operators that planned a bitmap fill it, the
+      //! lists of an AND in list mode are decoded and intersected, and the
+      //! filters are materialized, since the parents plan with the exact
+      //! counts these give. Explaining a query may then take a good share
+      //! of the time of running it.
+      //!
+      //! @param analyze run the query too and add the actual number of
+      //!                results, calls, postings decoded, blocks skipped
+      //!                and the wall time of every operator, the children
+      //!                included
+      //------------------------------------------------------------------------
+      Status explain( std::string       &plan,
+                      const std::string &query,
+                      bool               analyze = false );
+
     private:
-      const Index *pIndex;
+      const IndexReader           *pIndex;
+      size_t                       pExpansionLimit = DefaultExpansionLimit;
+      std::unique_ptr<QueryCache>  pCache;
+      std::unique_ptr<FilterCache> pFilters;
   };
 }
@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <Librarian/QueryParser.hh>
+#include <Librarian/LevenshteinAutomaton.hh>
 
 namespace Librarian
 {
@@ -74,7 +75,7 @@ namespace Librarian
     //--------------------------------------------------------------------------
     // Brackets
     //--------------------------------------------------------------------------
-    if( ch.getValue() == '(' || ch.getValue() == '(' )
+    if( ch.getValue() == '(' || ch.getValue() == ')' )
       return Token( std::string(1, ch.getValue()), Symbol, ch.getLine(),
                     ch.getColumn(), ch.getPosition() );
 
@@ -105,6 +106,10 @@ namespace Librarian
       t = BinaryOp;
     else if( tok == "NOT" )
       t = UnaryOp;
+    else if( tok.find( '~' ) != std::string::npos )
+      t = Fuzzy;
+    else if( tok.find_first_of( "*?" ) != std::string::npos )
+      t = Pattern;
     return Token( tok, t, line, column, position );
   }
 
@@ -242,14 +247,38 @@ namespace Librarian
   // Parse block3
   //
   // block3 = searchTerm
+  //          | pattern
+  //          | fuzzyTerm
   //          | "NOT" block3
   //          | "(" block1 ")"
   //----------------------------------------------------------------------------
   Status QueryParser::block3(Node *&parseTree)
   {
-    if( pToken.getType() == QueryLexer::Term )
+    if( pToken.getType() == QueryLexer::Term ||
+        pToken.getType() == QueryLexer::Pattern )
     {
-      parseTree = new Node(QueryLexer::Term, pToken.getValue());
+      parseTree = new Node(pToken.getType(), pToken.getValue());
+      getNextToken();
+      return Status();
+    }
+
+    //--------------------------------------------------------------------------
+    // A fuzzy term is a plain term followed by "~" and optionally the
+    // edit distance
+    //--------------------------------------------------------------------------
+    if( pToken.getType() == QueryLexer::Fuzzy )
+    {
+      const std::string &tok   = pToken.getValue();
+      size_t             tilde = tok.find( '~' );
+      std::string        dist  = tok.substr( tilde+1 );
+      if( tilde == 0 || tok.find_first_of( "*?" ) < tilde ||
+          dist.find_first_not_of( "0123456789" ) != std::string::npos ||
+          dist.size() > 1 ||
+          (!dist.empty() &&
+           (uint32_t)(dist[0]-'0') > LevenshteinAutomaton::MaxDistance) )
+        return Status( Status::errSyntax,
+                       tokenError("Invalid fuzzy term") );
+      parseTree = new Node(QueryLexer::Fuzzy, tok);
       getNextToken();
       return Status();
     }
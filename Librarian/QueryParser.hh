@@ -79,6 +79,8 @@ namespace Librarian
       {
         Unknown,   //<! Unknown tokey type
         Term,      //<! A search term
+        Pattern,   //<! A search term with "*" or "?" wildcards
+        Fuzzy,     //<! A search term with "~" and the edit distance
         Symbol,    //<! "(" or ")"
         BinaryOp,  //<! "AND" or "OR"
         UnaryOp,   //<! "NOT"
@@ -0,0 +1,290 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+#include <Librarian/QueryRewriter.hh>
+#include <Librarian/IndexReader.hh>
+#include <Librarian/Postings.hh>
+
+using namespace Librarian;
+
+namespace
+{
+  typedef QueryParser::Node Node;
+
+  bool isNot( const Node *node )
+  {
+    return node && node->getType() == QueryLexer::UnaryOp;
+  }
+
+  bool isOp( const Node *node, bool isAnd )
+  {
+    return node && node->getType() == QueryLexer::BinaryOp &&
+           (node->getToken() == "AND") == isAnd;
+  }
+
+  Node *makeAll()
+  {
+    return new Node( QueryLexer::UnaryOp, "NOT" );
+  }
+
+  //----------------------------------------------------------------------------
+  // Take the children away from the node and delete it
+  //----------------------------------------------------------------------------
+  std::vector<Node*> release( Node *node )
+  {
+    std::vector<Node*> children = node->getChildren();
+    node->clearChildren();
+    delete node;
+    return children;
+  }
+
+  void deleteAll( const std::vector<Node*> &nodes )
+  {
+    for( auto n: nodes )
+      delete n;
+  }
+
+  std::string lowercase( const std::string &str )
+  {
+    std::string result( str );
+    std::transform( result.begin(), result.end(), result.begin(), tolower );
+    return result;
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Rewrite the tree bottom up
+  //----------------------------------------------------------------------------
+  Node *QueryRewriter::rewrite( Node *tree )
+  {
+    if( !tree )
+      return nullptr;
+
+    switch( tree->getType() )
+    {
+      case QueryLexer::Term:
+      {
+        std::string  term = lowercase( tree->getToken() );
+        TermPostings postings;
+        delete tree;
+        if( !pIndex->findTerm( term, postings ) )
+          return nullptr;
+        return new Node( QueryLexer::Term, term );
+      }
+
+      case QueryLexer::Pattern:
+      case QueryLexer::Fuzzy:
+      {
+        Node *node = new Node( tree->getType(),
+                               lowercase( tree->getToken() ) );
+        delete tree;
+        return node;
+      }
+
+      case QueryLexer::UnaryOp:
+      {
+        if( isAll( tree ) )
+          return tree;
+        Nodes children = release( tree );
+        return negate( rewrite( children[0] ) );
+      }
+
+      case QueryLexer::BinaryOp:
+      {
+        bool  isAnd    = tree->getToken() == "AND";
+        Nodes operands = release( tree );
+        for( auto &n: operands )
+          n = rewrite( n );
+        return combine( isAnd, operands );
+      }
+
+      default:
+        return tree;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // All the documents
+  //----------------------------------------------------------------------------
+  bool QueryRewriter::isAll( const Node *tree )
+  {
+    return isNot( tree ) && tree->getChildren().empty();
+  }
+
+  //----------------------------------------------------------------------------
+  // Canonical text
+  //----------------------------------------------------------------------------
+  std::string QueryRewriter::toString( const Node *tree )
+  {
+    if( !tree )
+      return "()";
+
+    switch( tree->getType() )
+    {
+      case QueryLexer::UnaryOp:
+        if( tree->getChildren().empty() )
+          return "NOT ()";
+        return "NOT " + toString( tree->getChildren()[0] );
+
+      case QueryLexer::BinaryOp:
+      {
+        std::string str = "(";
+        for( auto c: tree->getChildren() )
+        {
+          if( str.size() > 1 )
+            str += " " + tree->getToken() + " ";
+          str += toString( c );
+        }
+        return str + ")";
+      }
+
+      default:
+        return tree->getToken();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Negate a rewritten node
+  //----------------------------------------------------------------------------
+  Node *QueryRewriter::negate( Node *node )
+  {
+    if( !node )
+      return makeAll();
+
+    if( isAll( node ) )
+    {
+      delete node;
+      return nullptr;
+    }
+
+    if( isNot( node ) )
+      return release( node )[0];
+
+    //--------------------------------------------------------------------------
+    // De Morgan if more than half of the operands are negated
+    //--------------------------------------------------------------------------
+    if( node->getType() == QueryLexer::BinaryOp )
+    {
+      size_t negated = std::count_if( node->childrenBegin(),
+                                      node->childrenEnd(), isNot );
+      size_t size = node->getChildren().size();
+      if( size - negated < negated + 1 )
+      {
+        bool  isAnd    = node->getToken() == "AND";
+        Nodes operands = release( node );
+        for( auto &n: operands )
+          n = negate( n );
+        return combine( !isAnd, operands );
+      }
+    }
+
+    Node *n = new Node( QueryLexer::UnaryOp, "NOT" );
+    n->addChild( node );
+    return n;
+  }
+
+  //----------------------------------------------------------------------------
+  // Build an operator over the rewritten operands, they are taken over
+  //----------------------------------------------------------------------------
+  Node *QueryRewriter::combine( bool isAnd, Nodes &operands )
+  {
+    //--------------------------------------------------------------------------
+    // Fold the constants and flatten; an empty set is the zero of AND and
+    // the identity of OR, the full set the other way round
+    //--------------------------------------------------------------------------
+    Nodes flat;
+    for( size_t i = 0; i < operands.size(); ++i )
+    {
+      Node *n = operands[i];
+      if( (isAnd && !n) || (!isAnd && isAll( n )) )
+      {
+        deleteAll( flat );
+        operands.erase( operands.begin(), operands.begin()+i+1 );
+        deleteAll( operands );
+        operands.clear();
+        return n;
+      }
+      if( !n || isAll( n ) )
+        delete n;
+      else if( isOp( n, isAnd ) )
+      {
+        Nodes children = release( n );
+        flat.insert( flat.end(), children.begin(), children.end() );
+      }
+      else
+        flat.push_back( n );
+    }
+    operands.clear();
+
+    //--------------------------------------------------------------------------
+    // Remove the duplicates, x together with NOT x is the zero
+    //--------------------------------------------------------------------------
+    std::map<std::string, Node*> unique;
+    Nodes                        negated;
+    for( auto n: flat )
+    {
+      if( !unique.emplace( toString( n ), n ).second )
+        delete n;
+    }
+    for( auto &u: unique )
+    {
+      if( !isNot( u.second ) )
+        continue;
+      if( unique.count( toString( u.second->getChildren()[0] ) ) )
+      {
+        for( auto &v: unique )
+          delete v.second;
+        return isAnd ? nullptr : makeAll();
+      }
+      negated.push_back( u.second );
+    }
+
+    //--------------------------------------------------------------------------
+    // Merge the negated operands: NOT a OR NOT b is NOT (a AND b), and
+    // the other way round; the number of negations drops, so this ends
+    //--------------------------------------------------------------------------
+    if( negated.size() > 1 )
+    {
+      Nodes rest, inner;
+      for( auto &u: unique )
+        if( !isNot( u.second ) )
+          rest.push_back( u.second );
+      for( auto n: negated )
+        inner.push_back( release( n )[0] );
+      rest.push_back( negate( combine( !isAnd, inner ) ) );
+      return combine( isAnd, rest );
+    }
+
+    if( unique.empty() )
+      return isAnd ? makeAll() : nullptr;
+    if( unique.size() == 1 )
+      return unique.begin()->second;
+
+    Node *node = new Node( QueryLexer::BinaryOp, isAnd ? "AND" : "OR" );
+    for( auto &u: unique )
+      node->addChild( u.second );
+    return node;
+  }
+}
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Librarian/QueryParser.hh>
+
+namespace Librarian
+{
+  class IndexReader;
+
+  //----------------------------------------------------------------------------
+  //! Rewrite a parse tree to a canonical, minimal one before it is executed
+  //!
+  //! The rules are:
+  //!  - nested operators of the same kind are flattened;
+  //!  - repeated operands are removed and the rest are sorted;
+  //!  - the terms missing from the index are folded as empty sets, an
+  //!    operand together with its negation as empty or full ones;
+  //!  - double negations are removed;
+  //!  - two or more negated operands are merged into a single NOT, and a
+  //!    NOT goes down into an operator if that removes negations (De
+  //!    Morgan), since every NOT complements over the whole index.
+  //!
+  //! An empty result is returned as a null tree and the set of all the
+  //! documents as a NOT without an operand. The wildcards and fuzzy terms
+  //! are kept as they are, they are expanded by the executor.
+  //----------------------------------------------------------------------------
+  class QueryRewriter
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      QueryRewriter( const IndexReader *index ): pIndex( index ) {}
+
+      //------------------------------------------------------------------------
+      //! Rewrite the tree
+      //!
+      //! @param tree the tree to rewrite, it is taken over
+      //! @return     the rewritten tree
+      //------------------------------------------------------------------------
+      QueryParser::Node *rewrite( QueryParser::Node *tree );
+
+      //------------------------------------------------------------------------
+      //! Does the tree stand for all the documents
+      //------------------------------------------------------------------------
+      static bool isAll( const QueryParser::Node *tree );
+
+      //------------------------------------------------------------------------
+      //! Canonical text of the tree, the same for the trees that rewrite to
+      //! the same thing
+      //------------------------------------------------------------------------
+      static std::string toString( const QueryParser::Node *tree );
+
+    private:
+      typedef std::vector<QueryParser::Node*> Nodes;
+
+      QueryParser::Node *negate( QueryParser::Node *node );
+      QueryParser::Node *combine( bool isAnd, Nodes &operands );
+
+      const IndexReader *pIndex;
+  };
+}
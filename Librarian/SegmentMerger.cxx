@@ -0,0 +1,320 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <memory>
+#include <queue>
+#include <cstdio>
+
+#include <Librarian/SegmentMerger.hh>
+#include <Librarian/MappedIndex.hh>
+#include <Librarian/IndexFile.hh>
+
+namespace
+{
+  using namespace Librarian;
+
+  typedef TermDictionary::Iterator TermCursor;
+
+  //----------------------------------------------------------------------------
+  // Order the segments by their current term and then by their position,
+  // the smallest first
+  //----------------------------------------------------------------------------
+  struct CursorOrder
+  {
+    bool operator () ( size_t a, size_t b ) const
+    {
+      if( cursors[a].term() != cursors[b].term() )
+        return cursors[a].term() > cursors[b].term();
+      return a > b;
+    }
+    const std::vector<TermCursor> &cursors;
+  };
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Level of a segment
+  //----------------------------------------------------------------------------
+  uint32_t MergePolicy::level( const IndexDirectory::Segment &segment ) const
+  {
+    uint64_t size  = segment.endDocId - segment.firstDocId;
+    uint64_t limit = pMinSegmentSize * pMergeFactor;
+    uint32_t lvl   = 0;
+    while( size >= limit )
+    {
+      ++lvl;
+      if( limit > ~(uint64_t)0 / pMergeFactor )
+        break;
+      limit *= pMergeFactor;
+    }
+    return lvl;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find a run of segments to merge
+  //----------------------------------------------------------------------------
+  bool MergePolicy::findMerge(
+    const std::vector<IndexDirectory::Segment> &segments,
+    size_t                                     &begin,
+    size_t                                     &end ) const
+  {
+    size_t   runStart = 0;
+    uint32_t runLevel = 0;
+    for( size_t i = 0; i < segments.size(); ++i )
+    {
+      uint32_t lvl = level( segments[i] );
+      if( i == 0 || lvl != runLevel )
+      {
+        runStart = i;
+        runLevel = lvl;
+      }
+      if( i+1 - runStart == pMergeFactor )
+      {
+        begin = runStart;
+        end   = i+1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  // Destructor
+  //----------------------------------------------------------------------------
+  SegmentMerger::~SegmentMerger()
+  {
+    wait();
+  }
+
+  //----------------------------------------------------------------------------
+  // Merge a run of consecutive segments into one
+  //----------------------------------------------------------------------------
+  Status SegmentMerger::merge(
+    const std::vector<IndexDirectory::Segment> &segments )
+  {
+    if( segments.size() < 2 )
+      return Status();
+
+    //--------------------------------------------------------------------------
+    // Map and verify the input, the merge reads all of it anyway and must
+    // not carry a corrupted block over into the merged segment
+    //--------------------------------------------------------------------------
+    std::vector<std::unique_ptr<MappedIndex>> inputs;
+    uint64_t numDocuments = 0;
+    for( auto &s: segments )
+    {
+      std::unique_ptr<MappedIndex> input( new MappedIndex() );
+      Status st = input->open( pDirectory->getSegmentPath( s ), true );
+      if( !st.isOK() )
+        return st;
+      numDocuments += input->numDocuments();
+      inputs.push_back( std::move( input ) );
+    }
+
+    IndexDirectory::Segment merged = { pDirectory->newSegmentName(),
+                                       segments.front().firstDocId,
+                                       segments.back().endDocId };
+    IndexFileWriter writer;
+    Status st = writer.open( pDirectory->getSegmentPath( merged ) );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // Merge the dictionaries; the postings of a term are the postings of
+    // all the segments in order, so they only need to be repacked
+    //--------------------------------------------------------------------------
+    std::vector<TermCursor> cursors;
+    std::vector<uint64_t>   consumed( inputs.size(), 0 );
+    for( auto &input: inputs )
+      cursors.push_back( input->getFile().getDictionary().begin() );
+
+    std::priority_queue<size_t, std::vector<size_t>, CursorOrder> heap(
+      CursorOrder{ cursors } );
+    for( size_t i = 0; i < inputs.size(); ++i )
+      if( cursors[i].valid() )
+        heap.push( i );
+
+    TermDictionaryWriter dictionary;
+    std::string          name;
+    writer.beginSection( IndexFile::PostingsSection );
+    while( !heap.empty() )
+    {
+      name.assign( cursors[heap.top()].term() );
+      PostingList postings;
+      while( !heap.empty() && cursors[heap.top()].term() == name )
+      {
+        size_t           segment = heap.top();
+        TermCursor      &cursor  = cursors[segment];
+        const IndexFile &file    = inputs[segment]->getFile();
+        heap.pop();
+
+        const IndexFile::TermEntry &entry = cursor.entry();
+        if( !file.isValid( entry ) )
+          return Status( Status::errIO, "Index file corrupted: bad term" );
+        PostingReader reader( PostingsView( file.getBlockHeaders( entry ),
+                                            entry.numBlocks,
+                                            file.getBlockData( entry ),
+                                            entry.dataLength, 0, 0,
+                                            entry.numPostings ) );
+        docid_t id;
+        while( reader.next( id ) )
+          postings.add( id );
+
+        ++consumed[segment];
+        cursor.next();
+        if( cursor.valid() )
+          heap.push( segment );
+      }
+      postings.seal();
+
+      IndexFile::TermEntry entry;
+      writer.appendPostings( postings, entry );
+      dictionary.add( name, entry );
+    }
+    writer.endSection();
+
+    //--------------------------------------------------------------------------
+    // A dictionary that stopped decoding early is corrupted
+    //--------------------------------------------------------------------------
+    for( size_t i = 0; i < inputs.size(); ++i )
+      if( consumed[i] != inputs[i]->getFile().numTerms() )
+        return Status( Status::errIO, "Index file corrupted: bad term" );
+    writer.appendDictionary( dictionary );
+
+    //--------------------------------------------------------------------------
+    // Concatenate the document tables
+    //--------------------------------------------------------------------------
+    writer.beginSection( IndexFile::DocOffsetsSection );
+    uint64_t offset  = 0;
+    size_t   segment = 0;
+    for( docid_t id = merged.firstDocId; id < merged.endDocId; ++id )
+    {
+      writer.append( &offset, sizeof(offset) );
+      while( segments[segment].endDocId <= id )
+        ++segment;
+      offset += inputs[segment]->getDocumentName( id ).size();
+    }
+    writer.append( &offset, sizeof(offset) );
+    writer.endSection();
+
+    writer.beginSection( IndexFile::DocNamesSection );
+    for( auto &input: inputs )
+      for( docid_t id = input->nextDocument( 0 ); id;
+           id = input->nextDocument( id ) )
+      {
+        std::string_view name = input->getDocumentName( id );
+        writer.append( name.data(), name.size() );
+      }
+    writer.endSection();
+
+    st = writer.commit( dictionary.size(), numDocuments, merged.firstDocId,
+                        merged.endDocId );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // Swap the segments
+    //--------------------------------------------------------------------------
+    return pDirectory->replaceSegments( segments, merged );
+  }
+
+  //----------------------------------------------------------------------------
+  // Run the merges picked by the policy until there are none left
+  //----------------------------------------------------------------------------
+  Status SegmentMerger::maybeMerge( const MergePolicy &policy )
+  {
+    while( true )
+    {
+      std::vector<IndexDirectory::Segment> segments;
+      segments = pDirectory->getSnapshot();
+      size_t begin, end;
+      if( !policy.findMerge( segments, begin, end ) )
+        return Status();
+
+      Status st = merge( std::vector<IndexDirectory::Segment>(
+                           segments.begin()+begin, segments.begin()+end ) );
+      if( !st.isOK() )
+        return st;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Merge all the segments into one
+  //----------------------------------------------------------------------------
+  Status SegmentMerger::optimize()
+  {
+    return merge( pDirectory->getSnapshot() );
+  }
+
+  //----------------------------------------------------------------------------
+  // Run maybeMerge in a background thread
+  //----------------------------------------------------------------------------
+  void SegmentMerger::startBackground( const MergePolicy &policy )
+  {
+    std::lock_guard<std::mutex> lock( pMutex );
+    pPolicy = policy;
+    if( pRunning )
+    {
+      pAgain = true;
+      return;
+    }
+
+    if( pThread.joinable() )
+      pThread.join();
+    pRunning = true;
+    pThread = std::thread( [this]()
+    {
+      while( true )
+      {
+        MergePolicy policy;
+        {
+          std::lock_guard<std::mutex> lock( pMutex );
+          policy = pPolicy;
+          pAgain = false;
+        }
+        Status st = maybeMerge( policy );
+
+        std::lock_guard<std::mutex> lock( pMutex );
+        pStatus = st;
+        if( !pAgain || !st.isOK() )
+        {
+          pRunning = false;
+          return;
+        }
+      }
+    } );
+  }
+
+  //----------------------------------------------------------------------------
+  // Wait for the background merges to finish
+  //----------------------------------------------------------------------------
+  Status SegmentMerger::wait()
+  {
+    std::unique_lock<std::mutex> lock( pMutex );
+    if( pThread.joinable() )
+    {
+      std::thread thread = std::move( pThread );
+      lock.unlock();
+      thread.join();
+      lock.lock();
+    }
+    return pStatus;
+  }
+}
@@ -0,0 +1,127 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include <Librarian/Status.hh>
+#include <Librarian/IndexDirectory.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Log-structured merge policy: segments are assigned to levels growing
+  //! by a factor of mergeFactor in the number of documents they cover, and
+  //! mergeFactor consecutive segments of the same level get merged into
+  //! one of the next level. Only consecutive segments are ever merged so
+  //! that the document ranges stay ascending.
+  //----------------------------------------------------------------------------
+  class MergePolicy
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //!
+      //! @param mergeFactor    number of segments merged at a time
+      //! @param minSegmentSize segments covering fewer documents count as
+      //!                       this big
+      //------------------------------------------------------------------------
+      MergePolicy( uint32_t mergeFactor = 10, uint64_t minSegmentSize = 1000 ):
+        pMergeFactor( std::max( mergeFactor, 2u ) ),
+        pMinSegmentSize( std::max( minSegmentSize, (uint64_t)1 ) ) {}
+
+      //------------------------------------------------------------------------
+      //! Find a run of segments to merge
+      //!
+      //! @param begin first segment of the run
+      //! @param end   one past the last segment of the run
+      //! @return      false if nothing needs merging
+      //------------------------------------------------------------------------
+      bool findMerge( const std::vector<IndexDirectory::Segment> &segments,
+                      size_t                                     &begin,
+                      size_t                                     &end ) const;
+
+    private:
+      uint32_t level( const IndexDirectory::Segment &segment ) const;
+
+      uint32_t pMergeFactor;
+      uint64_t pMinSegmentSize;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Merge segments of an index opened for writing. The segments are
+  //! merged term by term in a k-way merge of their dictionaries, the
+  //! readers keep using the old segments until the manifest is replaced.
+  //----------------------------------------------------------------------------
+  class SegmentMerger
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Constructor
+      //------------------------------------------------------------------------
+      SegmentMerger( IndexDirectory *directory ): pDirectory( directory ) {}
+
+      //------------------------------------------------------------------------
+      //! Destructor, waits for the background merges
+      //------------------------------------------------------------------------
+      ~SegmentMerger();
+
+      //------------------------------------------------------------------------
+      //! Merge a run of consecutive segments into one
+      //------------------------------------------------------------------------
+      Status merge( const std::vector<IndexDirectory::Segment> &segments );
+
+      //------------------------------------------------------------------------
+      //! Run the merges picked by the policy until there are none left
+      //------------------------------------------------------------------------
+      Status maybeMerge( const MergePolicy &policy );
+
+      //------------------------------------------------------------------------
+      //! Merge all the segments into one
+      //------------------------------------------------------------------------
+      Status optimize();
+
+      //------------------------------------------------------------------------
+      //! Run maybeMerge in a background thread unless it already runs;
+      //! new segments may be added to the index in the meantime
+      //------------------------------------------------------------------------
+      void startBackground( const MergePolicy &policy );
+
+      //------------------------------------------------------------------------
+      //! Wait for the background merges to finish
+      //!
+      //! @return the status of the last background merge
+      //------------------------------------------------------------------------
+      Status wait();
+
+    private:
+      IndexDirectory *pDirectory;
+      std::thread     pThread;
+      std::mutex      pMutex;
+      Status          pStatus;
+      bool            pRunning = false;
+      bool            pAgain   = false;
+      MergePolicy     pPolicy;
+  };
+}
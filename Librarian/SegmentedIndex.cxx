@@ -0,0 +1,208 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <map>
+
+#include <Librarian/SegmentedIndex.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Open the index
+  //----------------------------------------------------------------------------
+  Status SegmentedIndex::open( const std::string &path, bool verify )
+  {
+    Status st = pDirectory.open( path );
+    if( !st.isOK() )
+      return st;
+
+    //--------------------------------------------------------------------------
+    // A merge may replace the manifest and remove the segments it lists
+    // in the meantime, try again with the new manifest then
+    //--------------------------------------------------------------------------
+    for( int attempt = 0; attempt < 5; ++attempt )
+    {
+      st = openSegments( verify );
+      if( st.isOK() )
+        return st;
+
+      uint64_t generation = pDirectory.getGeneration();
+      if( !pDirectory.reload().isOK() ||
+          pDirectory.getGeneration() == generation )
+        break;
+    }
+    return st;
+  }
+
+  //----------------------------------------------------------------------------
+  // Map the segments listed in the manifest
+  //----------------------------------------------------------------------------
+  Status SegmentedIndex::openSegments( bool verify )
+  {
+    pSegments.clear();
+    pNumDocuments = 0;
+    ++pVersion;
+    for( auto &s: pDirectory.getSegments() )
+    {
+      std::unique_ptr<MappedIndex> segment( new MappedIndex() );
+      Status st = segment->open( pDirectory.getSegmentPath( s ), verify );
+      if( !st.isOK() )
+      {
+        pSegments.clear();
+        return st;
+      }
+      pNumDocuments += segment->numDocuments();
+      pSegments.push_back( std::move( segment ) );
+    }
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the postings of a term
+  //----------------------------------------------------------------------------
+  bool SegmentedIndex::findTerm( std::string_view  term,
+                                 TermPostings     &postings ) const
+  {
+    TermPostings part;
+    bool         found = false;
+    postings.clear();
+    for( auto &segment: pSegments )
+    {
+      if( !segment->findTerm( term, part ) )
+        continue;
+      found = true;
+      for( size_t i = 0; i < part.numParts(); ++i )
+        postings.add( part.getPart( i ) );
+    }
+    return found;
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms starting with the prefix
+  //----------------------------------------------------------------------------
+  void SegmentedIndex::visitTerms( std::string_view   prefix,
+                                   const TermVisitor &visitor ) const
+  {
+    std::vector<TermDictionary::Iterator> cursors;
+    for( auto &segment: pSegments )
+      cursors.push_back(
+        segment->getFile().getDictionary().lowerBound( prefix ) );
+
+    auto matches = [&]( size_t i )
+      { return cursors[i].valid() && cursors[i].term().starts_with( prefix ); };
+
+    //--------------------------------------------------------------------------
+    // There are few segments, so a linear scan for the smallest term is
+    // good enough; the parts are added in segment order to keep the ids
+    // ascending
+    //--------------------------------------------------------------------------
+    std::string  term;
+    TermPostings postings;
+    while( 1 )
+    {
+      size_t first = cursors.size();
+      for( size_t i = 0; i < cursors.size(); ++i )
+        if( matches( i ) &&
+            (first == cursors.size() ||
+             cursors[i].term() < cursors[first].term()) )
+          first = i;
+      if( first == cursors.size() )
+        return;
+
+      term.assign( cursors[first].term() );
+      postings.clear();
+      for( size_t i = first; i < cursors.size(); ++i )
+      {
+        if( !matches( i ) || cursors[i].term() != term )
+          continue;
+        const IndexFile &file = pSegments[i]->getFile();
+        if( file.isValid( cursors[i].entry() ) )
+          postings.add( pSegments[i]->getPostings( cursors[i].entry() ) );
+        cursors[i].next();
+      }
+
+      if( !postings.empty() && !visitor( term, postings ) )
+        return;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Visit all the terms within the edit distance from the term, there are
+  // few of them, so they are collected from all the segments first
+  //----------------------------------------------------------------------------
+  void SegmentedIndex::visitSimilarTerms( std::string_view   term,
+                                          uint32_t           maxDistance,
+                                          const TermVisitor &visitor ) const
+  {
+    LevenshteinAutomaton                automaton( term, maxDistance );
+    std::map<std::string, TermPostings> terms;
+    for( auto &segment: pSegments )
+      segment->visitAcceptedTerms( automaton,
+        [&]( std::string_view term, const TermPostings &postings )
+        {
+          TermPostings &all = terms[std::string( term )];
+          for( size_t i = 0; i < postings.numParts(); ++i )
+            all.add( postings.getPart( i ) );
+          return true;
+        } );
+
+    for( auto &t: terms )
+      if( !visitor( t.first, t.second ) )
+        return;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the segment holding the given id or the first one after it
+  //----------------------------------------------------------------------------
+  size_t SegmentedIndex::findSegment( docid_t id ) const
+  {
+    auto &segments = pDirectory.getSegments();
+    auto  it = std::upper_bound( segments.begin(), segments.end(), id,
+                                 []( docid_t id,
+                                     const IndexDirectory::Segment &s )
+                                   { return id < s.endDocId; } );
+    return it - segments.begin();
+  }
+
+  //----------------------------------------------------------------------------
+  // Get document name for the given id
+  //----------------------------------------------------------------------------
+  std::string_view SegmentedIndex::getDocumentName( docid_t id ) const
+  {
+    size_t segment = findSegment( id );
+    if( segment == pSegments.size() )
+      return std::string_view();
+    return pSegments[segment]->getDocumentName( id );
+  }
+
+  //----------------------------------------------------------------------------
+  // Get the first document with an id larger than the given one
+  //----------------------------------------------------------------------------
+  docid_t SegmentedIndex::nextDocument( docid_t id ) const
+  {
+    for( size_t i = findSegment( id ); i < pSegments.size(); ++i )
+    {
+      docid_t next = pSegments[i]->nextDocument( id );
+      if( next )
+        return next;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Librarian/Status.hh>
+#include <Librarian/IndexReader.hh>
+#include <Librarian/IndexDirectory.hh>
+#include <Librarian/MappedIndex.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Read-only view of all the live segments of an index directory, each
+  //! of them memory-mapped
+  //----------------------------------------------------------------------------
+  class SegmentedIndex: public IndexReader
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Open the index
+      //!
+      //! @param verify verify the segment files, see MappedIndex::open
+      //------------------------------------------------------------------------
+      Status open( const std::string &path, bool verify = false );
+
+      //------------------------------------------------------------------------
+      //! Get the generation of the manifest the segments come from
+      //------------------------------------------------------------------------
+      uint64_t getGeneration() const
+      {
+        return pDirectory.getGeneration();
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the number of segments
+      //------------------------------------------------------------------------
+      size_t numSegments() const
+      {
+        return pSegments.size();
+      }
+
+      //------------------------------------------------------------------------
+      //! Find the postings of a term
+      //------------------------------------------------------------------------
+      virtual bool findTerm( std::string_view  term,
+                             TermPostings     &postings ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms starting with the prefix, merging the
+      //! dictionaries of the segments
+      //------------------------------------------------------------------------
+      virtual void visitTerms( std::string_view   prefix,
+                               const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Visit all the terms within the edit distance from the term
+      //------------------------------------------------------------------------
+      virtual void visitSimilarTerms( std::string_view   term,
+                                      uint32_t           maxDistance,
+                                      const TermVisitor &visitor ) const;
+
+      //------------------------------------------------------------------------
+      //! Get document name for the given id
+      //------------------------------------------------------------------------
+      virtual std::string_view getDocumentName( docid_t id ) const;
+
+      //------------------------------------------------------------------------
+      //! Get the first document with an id larger than the given one
+      //------------------------------------------------------------------------
+      virtual docid_t nextDocument( docid_t id ) const;
+
+      //------------------------------------------------------------------------
+      //! Set the bits of all the documents in use
+      //------------------------------------------------------------------------
+      virtual void fillDocuments( Bitmap &bitmap ) const
+      {
+        for( auto &segment: pSegments )
+          segment->fillDocuments( bitmap );
+      }
+
+      //------------------------------------------------------------------------
+      //! Get number of documents
+      //------------------------------------------------------------------------
+      virtual docid_t numDocuments() const
+      {
+        return pNumDocuments;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the largest document id in use
+      //------------------------------------------------------------------------
+      virtual docid_t maxDocId() const
+      {
+        return pDirectory.getNextDocId()-1;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the version of the contents, it changes whenever the set of
+      //! segments is opened
+      //------------------------------------------------------------------------
+      virtual uint64_t getVersion() const
+      {
+        return pVersion;
+      }
+
+    private:
+      Status openSegments( bool verify );
+      size_t findSegment( docid_t id ) const;
+
+      IndexDirectory                            pDirectory;
+      std::vector<std::unique_ptr<MappedIndex>> pSegments;
+      docid_t                                   pNumDocuments = 0;
+      uint64_t                                  pVersion      = 0;
+  };
+}
@@ -23,7 +23,8 @@
 
 namespace
 {
-  std::vector<std::string> gMessages = {"Success", "I/O Error", "Syntax Error"};
+  std::vector<std::string> gMessages = {"Success", "I/O Error", "Syntax Error",
+                                      "Limit Exceeded"};
 }
 
 namespace Librarian
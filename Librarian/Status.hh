@@ -32,6 +32,7 @@ namespace Librarian
       static const uint16_t success     = 0x0000; //!< All went well
       static const uint16_t errIO       = 0x0001; //!< An IO error has occurred
       static const uint16_t errSyntax   = 0x0002; //!< Syntax error
+      static const uint16_t errLimit    = 0x0003; //!< A limit was exceeded
 
       //------------------------------------------------------------------------
       //! Constructor
@@ -0,0 +1,331 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include <Librarian/TermDictionary.hh>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Append a LEB128 varint
+  //----------------------------------------------------------------------------
+  void writeVarint( std::vector<uint8_t> &out, uint64_t value )
+  {
+    while( value >= 0x80 )
+    {
+      out.push_back( (value & 0x7f) | 0x80 );
+      value >>= 7;
+    }
+    out.push_back( value );
+  }
+
+  //----------------------------------------------------------------------------
+  // Read a LEB128 varint, fail rather than read past the end
+  //----------------------------------------------------------------------------
+  bool readVarint( const uint8_t *&p, const uint8_t *end, uint64_t &value )
+  {
+    value = 0;
+    for( uint32_t shift = 0; shift < 64 && p != end; shift += 7 )
+    {
+      uint8_t byte = *p++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if( !(byte & 0x80) )
+        return true;
+    }
+    return false;
+  }
+
+  Librarian::Status corrupted( const std::string &what )
+  {
+    return Librarian::Status( Librarian::Status::errIO,
+                              "Index file corrupted: " + what );
+  }
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Move to the next term
+  //----------------------------------------------------------------------------
+  void TermDictionary::Iterator::next()
+  {
+    if( !pValid )
+      return;
+    ++pInBlock;
+    if( pInBlock == BlockSize ||
+        pBlock*BlockSize + pInBlock == pDict->pNumTerms )
+      seekBlock( pBlock+1 );
+    else
+      decode();
+  }
+
+  //----------------------------------------------------------------------------
+  // Move forward to the first term not smaller than the given one
+  //----------------------------------------------------------------------------
+  void TermDictionary::Iterator::seek( std::string_view term )
+  {
+    if( !pValid || term <= pTerm )
+      return;
+
+    //--------------------------------------------------------------------------
+    // Find the first block following the current one that starts with
+    // a larger term: gallop to bracket it, then bisect
+    //--------------------------------------------------------------------------
+    uint64_t lo = pBlock+1, probe = pBlock+1, step = 1;
+    while( probe < pDict->pNumBlocks && pDict->firstTerm( probe ) <= term )
+    {
+      lo     = probe+1;
+      probe += step;
+      step  *= 2;
+    }
+    uint64_t hi = std::min( probe, pDict->pNumBlocks );
+    while( lo < hi )
+    {
+      uint64_t mid = lo + (hi-lo)/2;
+      if( pDict->firstTerm( mid ) <= term )
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+
+    if( lo != pBlock+1 && !seekBlock( lo-1 ) )
+      return;
+    while( pValid && pTerm < term )
+      next();
+  }
+
+  //----------------------------------------------------------------------------
+  // Point to the first term of a block
+  //----------------------------------------------------------------------------
+  bool TermDictionary::Iterator::seekBlock( uint64_t block )
+  {
+    pValid = false;
+    if( block >= pDict->pNumBlocks )
+      return false;
+
+    uint64_t begin = pDict->pIndex[block];
+    uint64_t end   = pDict->pIndex[block+1];
+    if( begin > end || end > pDict->pLength )
+      return false;
+
+    pBlock                = block;
+    pInBlock              = 0;
+    pCurrent              = pDict->pData + begin;
+    pBlockEnd             = pDict->pData + end;
+    pEntry.postingsOffset = 0;
+    pTerm.clear();
+    return decode();
+  }
+
+  //----------------------------------------------------------------------------
+  // Decode the term at the current position
+  //----------------------------------------------------------------------------
+  bool TermDictionary::Iterator::decode()
+  {
+    uint64_t prefix, suffix, delta, dataLength, numPostings, numBlocks;
+    pValid = false;
+    if( !readVarint( pCurrent, pBlockEnd, prefix ) ||
+        !readVarint( pCurrent, pBlockEnd, suffix ) ||
+        prefix > pTerm.size() || (pInBlock == 0 && prefix != 0) ||
+        suffix > (uint64_t)(pBlockEnd - pCurrent) )
+      return false;
+
+    pTerm.resize( prefix );
+    pTerm.append( (const char *)pCurrent, suffix );
+    pCurrent += suffix;
+
+    if( !readVarint( pCurrent, pBlockEnd, delta ) ||
+        !readVarint( pCurrent, pBlockEnd, dataLength ) ||
+        !readVarint( pCurrent, pBlockEnd, numPostings ) ||
+        !readVarint( pCurrent, pBlockEnd, numBlocks ) ||
+        numBlocks > 0xffffffff )
+      return false;
+
+    pEntry.postingsOffset += delta;
+    pEntry.dataLength      = dataLength;
+    pEntry.numPostings     = numPostings;
+    pEntry.numBlocks       = numBlocks;
+    pValid                 = true;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Attach to the dictionary data
+  //----------------------------------------------------------------------------
+  bool TermDictionary::open( const uint64_t *index,
+                             uint64_t        numIndex,
+                             const uint8_t  *data,
+                             uint64_t        length,
+                             uint64_t        numTerms )
+  {
+    if( numIndex == 0 ||
+        numIndex-1 != (numTerms+BlockSize-1)/BlockSize ||
+        index[0] != 0 || index[numIndex-1] > length )
+      return false;
+
+    pIndex     = index;
+    pNumBlocks = numIndex-1;
+    pData      = data;
+    pLength    = length;
+    pNumTerms  = numTerms;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // The first term of a block, it is stored in full so it can be used in
+  // place; a block that does not decode gives an empty term
+  //----------------------------------------------------------------------------
+  std::string_view TermDictionary::firstTerm( uint64_t block ) const
+  {
+    uint64_t begin = pIndex[block];
+    uint64_t end   = pIndex[block+1];
+    if( begin > end || end > pLength )
+      return std::string_view();
+
+    const uint8_t *p      = pData + begin;
+    const uint8_t *blkEnd = pData + end;
+    uint64_t       prefix, suffix;
+    if( !readVarint( p, blkEnd, prefix ) || !readVarint( p, blkEnd, suffix ) ||
+        prefix != 0 || suffix > (uint64_t)(blkEnd - p) )
+      return std::string_view();
+    return std::string_view( (const char *)p, suffix );
+  }
+
+  //----------------------------------------------------------------------------
+  // Iterator pointing to the first term
+  //----------------------------------------------------------------------------
+  TermDictionary::Iterator TermDictionary::begin() const
+  {
+    Iterator it;
+    it.pDict = this;
+    it.seekBlock( 0 );
+    return it;
+  }
+
+  //----------------------------------------------------------------------------
+  // Iterator pointing to the first term not smaller than the given one
+  //----------------------------------------------------------------------------
+  TermDictionary::Iterator TermDictionary::lowerBound(
+    std::string_view term ) const
+  {
+    //--------------------------------------------------------------------------
+    // Find the last block starting with a term not larger than the one we
+    // look for, the term is either there or at the beginning of the next one
+    //--------------------------------------------------------------------------
+    uint64_t lo = 0, hi = pNumBlocks;
+    while( lo < hi )
+    {
+      uint64_t mid = lo + (hi-lo)/2;
+      if( firstTerm( mid ) <= term )
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+
+    Iterator it;
+    it.pDict = this;
+    it.seekBlock( lo ? lo-1 : 0 );
+    while( it.valid() && it.term() < term )
+      it.next();
+    return it;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find a term
+  //----------------------------------------------------------------------------
+  bool TermDictionary::find( std::string_view term, Entry &entry ) const
+  {
+    Iterator it = lowerBound( term );
+    if( !it.valid() || it.term() != term )
+      return false;
+    entry = it.entry();
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Check that all the blocks decode and that the terms are sorted
+  //----------------------------------------------------------------------------
+  Status TermDictionary::validate() const
+  {
+    std::string last;
+    Iterator    it;
+    it.pDict = this;
+    for( uint64_t block = 0; block < pNumBlocks; ++block )
+    {
+      uint64_t num = std::min<uint64_t>( BlockSize,
+                                         pNumTerms - block*BlockSize );
+      if( !it.seekBlock( block ) )
+        return corrupted( "bad term dictionary block" );
+      for( uint64_t i = 0; i < num; ++i )
+      {
+        if( i && !it.decode() )
+          return corrupted( "bad term dictionary block" );
+        if( (block || i) && last >= it.term() )
+          return corrupted( "term dictionary not sorted" );
+        last = it.term();
+        ++it.pInBlock;
+      }
+      if( it.pCurrent != it.pBlockEnd )
+        return corrupted( "bad term dictionary block" );
+    }
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Add a term
+  //----------------------------------------------------------------------------
+  void TermDictionaryWriter::add( std::string_view             term,
+                                  const TermDictionary::Entry &entry )
+  {
+    if( pNumTerms % TermDictionary::BlockSize == 0 )
+    {
+      pIndex.push_back( pData.size() );
+      pLast.clear();
+      pLastOffset = 0;
+    }
+
+    size_t prefix = 0;
+    size_t common = std::min( pLast.size(), term.size() );
+    while( prefix < common && pLast[prefix] == term[prefix] )
+      ++prefix;
+
+    writeVarint( pData, prefix );
+    writeVarint( pData, term.size() - prefix );
+    pData.insert( pData.end(), term.begin()+prefix, term.end() );
+    writeVarint( pData, entry.postingsOffset - pLastOffset );
+    writeVarint( pData, entry.dataLength );
+    writeVarint( pData, entry.numPostings );
+    writeVarint( pData, entry.numBlocks );
+
+    pLast.assign( term.data(), term.size() );
+    pLastOffset = entry.postingsOffset;
+    ++pNumTerms;
+  }
+
+  //----------------------------------------------------------------------------
+  // Block offsets including the final length
+  //----------------------------------------------------------------------------
+  std::vector<uint64_t> TermDictionaryWriter::getIndex() const
+  {
+    std::vector<uint64_t> index( pIndex );
+    index.push_back( pData.size() );
+    return index;
+  }
+}
@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Librarian/Status.hh>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Sorted, immutable term dictionary made of front-coded blocks
+  //!
+  //! The terms are grouped in blocks of BlockSize. Within a block every term
+  //! is stored as the length of the prefix it shares with the previous one
+  //! and the remaining suffix, followed by its entry; all the numbers are
+  //! LEB128 varints and the postings offsets are deltas to the previous
+  //! term of the block. The first term of a block is stored in full, so
+  //! the block offsets (the sparse index) are enough to binary search for
+  //! the block of a term, which is then scanned. Both parts are used in
+  //! place.
+  //----------------------------------------------------------------------------
+  class TermDictionary
+  {
+    public:
+      static const uint32_t BlockSize = 16;
+
+      //------------------------------------------------------------------------
+      //! Where the postings of a term are
+      //------------------------------------------------------------------------
+      struct Entry
+      {
+        uint64_t postingsOffset; //!< offset in the Postings section
+        uint64_t dataLength;     //!< length of the data following the headers
+        uint64_t numPostings;
+        uint32_t numBlocks;
+      };
+
+      //------------------------------------------------------------------------
+      //! Walk the terms in order
+      //------------------------------------------------------------------------
+      class Iterator
+      {
+        public:
+          //--------------------------------------------------------------------
+          //! Check whether the iterator points to a term
+          //--------------------------------------------------------------------
+          bool valid() const
+          {
+            return pValid;
+          }
+
+          //--------------------------------------------------------------------
+          //! Move to the next term
+          //--------------------------------------------------------------------
+          void next();
+
+          //--------------------------------------------------------------------
+          //! Move forward to the first term not smaller than the given one,
+          //! the blocks are searched galloping from the current one, so
+          //! short jumps are cheap
+          //--------------------------------------------------------------------
+          void seek( std::string_view term );
+
+          //--------------------------------------------------------------------
+          //! The current term, valid until the iterator moves
+          //--------------------------------------------------------------------
+          std::string_view term() const
+          {
+            return pTerm;
+          }
+
+          //--------------------------------------------------------------------
+          //! The entry of the current term
+          //--------------------------------------------------------------------
+          const Entry &entry() const
+          {
+            return pEntry;
+          }
+
+        private:
+          friend class TermDictionary;
+          bool seekBlock( uint64_t block );
+          bool decode();
+
+          const TermDictionary *pDict     = 0;
+          uint64_t              pBlock    = 0;
+          uint32_t              pInBlock  = 0;
+          const uint8_t        *pCurrent  = 0;
+          const uint8_t        *pBlockEnd = 0;
+          std::string           pTerm;
+          Entry                 pEntry    = {};
+          bool                  pValid    = false;
+      };
+
+      //------------------------------------------------------------------------
+      //! Attach to the dictionary data
+      //!
+      //! @param index    block offsets, one per block plus the total length
+      //! @param numIndex number of the block offsets
+      //! @param data     the blocks
+      //! @param length   length of the blocks, padding included
+      //! @param numTerms number of terms
+      //! @return         false if the sizes do not add up
+      //------------------------------------------------------------------------
+      bool open( const uint64_t *index,
+                 uint64_t        numIndex,
+                 const uint8_t  *data,
+                 uint64_t        length,
+                 uint64_t        numTerms );
+
+      //------------------------------------------------------------------------
+      //! Number of terms
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pNumTerms;
+      }
+
+      //------------------------------------------------------------------------
+      //! Find a term
+      //------------------------------------------------------------------------
+      bool find( std::string_view term, Entry &entry ) const;
+
+      //------------------------------------------------------------------------
+      //! Iterator pointing to the first term
+      //------------------------------------------------------------------------
+      Iterator begin() const;
+
+      //------------------------------------------------------------------------
+      //! Iterator pointing to the first term not smaller than the given one
+      //------------------------------------------------------------------------
+      Iterator lowerBound( std::string_view term ) const;
+
+      //------------------------------------------------------------------------
+      //! Check that all the blocks decode and that the terms are sorted
+      //------------------------------------------------------------------------
+      Status validate() const;
+
+    private:
+      std::string_view firstTerm( uint64_t block ) const;
+
+      const uint64_t *pIndex     = 0;
+      uint64_t        pNumBlocks = 0;
+      const uint8_t  *pData      = 0;
+      uint64_t        pLength    = 0;
+      uint64_t        pNumTerms  = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  //! Build a term dictionary out of terms coming in sorted order
+  //----------------------------------------------------------------------------
+  class TermDictionaryWriter
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Add a term, it needs to be larger than the previous one
+      //------------------------------------------------------------------------
+      void add( std::string_view term, const TermDictionary::Entry &entry );
+
+      //------------------------------------------------------------------------
+      //! Number of terms
+      //------------------------------------------------------------------------
+      uint64_t size() const
+      {
+        return pNumTerms;
+      }
+
+      //------------------------------------------------------------------------
+      //! Block offsets including the final length
+      //------------------------------------------------------------------------
+      std::vector<uint64_t> getIndex() const;
+
+      //------------------------------------------------------------------------
+      //! The blocks
+      //------------------------------------------------------------------------
+      const std::vector<uint8_t> &getData() const
+      {
+        return pData;
+      }
+
+    private:
+      std::vector<uint64_t> pIndex;
+      std::vector<uint8_t>  pData;
+      std::string           pLast;
+      uint64_t              pLastOffset = 0;
+      uint64_t              pNumTerms   = 0;
+  };
+}
@@ -0,0 +1,387 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+
+#include <Librarian/TextKernels.hh>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBRARIAN_X86 1
+#endif
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Character classes
+  //----------------------------------------------------------------------------
+  inline bool isSpace( char c )
+  {
+    return c == ' ' || (unsigned char)(c - '\t') < 5;
+  }
+
+  inline bool isAlnum( char c )
+  {
+    return (unsigned char)(c - '0') < 10 ||
+           (unsigned char)((c | 0x20) - 'a') < 26;
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the first character of the class, or not of the class, scalar
+  //----------------------------------------------------------------------------
+  template<bool (*InClass)( char )>
+  inline const char *findScalar( const char *p, const char *end, bool want )
+  {
+    while( p != end && InClass( *p ) != want )
+      ++p;
+    return p;
+  }
+
+  const char *nextTokenScalar( const char  *begin,
+                               const char  *end,
+                               const char **tokenEnd )
+  {
+    const char *start = findScalar<isSpace>( begin, end, false );
+    *tokenEnd = findScalar<isSpace>( start, end, true );
+    return start;
+  }
+
+  const char *alnumRunScalar( const char  *begin,
+                              const char  *end,
+                              const char **runEnd )
+  {
+    const char *start = findScalar<isAlnum>( begin, end, true );
+    *runEnd = findScalar<isAlnum>( start, end, false );
+    return start;
+  }
+
+  size_t normalizeScalar( char *out, const char *begin, const char *end )
+  {
+    const char *p = findScalar<isAlnum>( begin, end, true );
+    char       *o = out;
+    for( ; p != end && isAlnum( *p ); ++p )
+      *o++ = *p | 0x20;
+    return o - out;
+  }
+
+  //----------------------------------------------------------------------------
+  // Mask of the first num bits of a chunk of the given width
+  //----------------------------------------------------------------------------
+  inline uint32_t validMask( size_t num, size_t width )
+  {
+    return num >= width ? (uint32_t)((1ull << width) - 1) :
+                          (uint32_t)((1ull << num) - 1);
+  }
+
+#ifdef LIBRARIAN_X86
+  //----------------------------------------------------------------------------
+  // The chunks of the vector kernels are read directly from the input as
+  // long as they fit, the last one is copied to a zeroed buffer first; zero
+  // is neither whitespace nor alphanumeric
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse2")))
+  inline __m128i load16( const char *p, const char *end )
+  {
+    if( end - p >= 16 )
+      return _mm_loadu_si128( (const __m128i*)p );
+    alignas(16) char buffer[16] = {};
+    memcpy( buffer, p, end-p );
+    return _mm_load_si128( (const __m128i*)buffer );
+  }
+
+  //----------------------------------------------------------------------------
+  // Unsigned range checks done with signed comparisons: c - lo < n maps to
+  // (c - lo) ^ 0x80 < n - 128
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse2")))
+  inline __m128i inRange16( __m128i v, char lo, int n )
+  {
+    __m128i t = _mm_add_epi8( v, _mm_set1_epi8( (char)(0x80 - lo) ) );
+    return _mm_cmplt_epi8( t, _mm_set1_epi8( (char)(n - 128) ) );
+  }
+
+  __attribute__((target("sse2")))
+  inline uint32_t spaceMask16( __m128i v )
+  {
+    __m128i sp = _mm_cmpeq_epi8( v, _mm_set1_epi8( ' ' ) );
+    return _mm_movemask_epi8( _mm_or_si128( sp, inRange16( v, '\t', 5 ) ) );
+  }
+
+  __attribute__((target("sse2")))
+  inline uint32_t alnumMask16( __m128i v )
+  {
+    __m128i lower = _mm_or_si128( v, _mm_set1_epi8( 0x20 ) );
+    __m128i m = _mm_or_si128( inRange16( v, '0', 10 ),
+                              inRange16( lower, 'a', 26 ) );
+    return _mm_movemask_epi8( m );
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the first character of the class, or not of the class, SSE2
+  //----------------------------------------------------------------------------
+  template<uint32_t (*Mask)( __m128i )>
+  __attribute__((target("sse2")))
+  inline const char *find16( const char *p, const char *end, bool want )
+  {
+    for( ; p < end; p += 16 )
+    {
+      uint32_t m = Mask( load16( p, end ) );
+      m = (want ? m : ~m) & validMask( end-p, 16 );
+      if( m )
+        return p + __builtin_ctz( m );
+    }
+    return end;
+  }
+
+  __attribute__((target("sse2")))
+  const char *nextTokenSSE2( const char  *begin,
+                             const char  *end,
+                             const char **tokenEnd )
+  {
+    const char *start = find16<spaceMask16>( begin, end, false );
+    *tokenEnd = find16<spaceMask16>( start, end, true );
+    return start;
+  }
+
+  __attribute__((target("sse2")))
+  const char *alnumRunSSE2( const char  *begin,
+                            const char  *end,
+                            const char **runEnd )
+  {
+    const char *start = find16<alnumMask16>( begin, end, true );
+    *runEnd = find16<alnumMask16>( start, end, false );
+    return start;
+  }
+
+  //----------------------------------------------------------------------------
+  // Every chunk is classified and lowercased once; the run starts at the
+  // first alphanumeric character and ends at the first one that is not.
+  // Setting 0x20 lowercases the letters and leaves the digits be.
+  //----------------------------------------------------------------------------
+  __attribute__((target("sse2")))
+  size_t normalizeSSE2( char *out, const char *begin, const char *end )
+  {
+    alignas(16) char lower[16];
+    char *o     = out;
+    bool  inRun = false;
+    for( const char *p = begin; p < end; p += 16 )
+    {
+      __m128i  v     = load16( p, end );
+      uint32_t valid = validMask( end-p, 16 );
+      uint32_t m     = alnumMask16( v ) & valid;
+      uint32_t from  = 0;
+      if( !inRun )
+      {
+        if( !m )
+          continue;
+        from  = __builtin_ctz( m );
+        inRun = true;
+      }
+
+      _mm_store_si128( (__m128i*)lower,
+                       _mm_or_si128( v, _mm_set1_epi8( 0x20 ) ) );
+      uint32_t stop = ~m & valid & (~0u << from);
+      uint32_t to   = stop ? __builtin_ctz( stop ) : end-p < 16 ? end-p : 16;
+      memcpy( o, lower+from, to-from );
+      o += to-from;
+      if( stop )
+        break;
+    }
+    return o - out;
+  }
+
+  //----------------------------------------------------------------------------
+  // The same with AVX2
+  //----------------------------------------------------------------------------
+  __attribute__((target("avx2")))
+  inline __m256i load32( const char *p, const char *end )
+  {
+    if( end - p >= 32 )
+      return _mm256_loadu_si256( (const __m256i*)p );
+    alignas(32) char buffer[32] = {};
+    memcpy( buffer, p, end-p );
+    return _mm256_load_si256( (const __m256i*)buffer );
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i inRange32( __m256i v, char lo, int n )
+  {
+    __m256i t = _mm256_add_epi8( v, _mm256_set1_epi8( (char)(0x80 - lo) ) );
+    return _mm256_cmpgt_epi8( _mm256_set1_epi8( (char)(n - 128) ), t );
+  }
+
+  __attribute__((target("avx2")))
+  inline uint32_t spaceMask32( __m256i v )
+  {
+    __m256i sp = _mm256_cmpeq_epi8( v, _mm256_set1_epi8( ' ' ) );
+    return _mm256_movemask_epi8( _mm256_or_si256( sp,
+                                                  inRange32( v, '\t', 5 ) ) );
+  }
+
+  __attribute__((target("avx2")))
+  inline uint32_t alnumMask32( __m256i v )
+  {
+    __m256i lower = _mm256_or_si256( v, _mm256_set1_epi8( 0x20 ) );
+    __m256i m = _mm256_or_si256( inRange32( v, '0', 10 ),
+                                 inRange32( lower, 'a', 26 ) );
+    return _mm256_movemask_epi8( m );
+  }
+
+  template<uint32_t (*Mask)( __m256i )>
+  __attribute__((target("avx2")))
+  inline const char *find32( const char *p, const char *end, bool want )
+  {
+    for( ; p < end; p += 32 )
+    {
+      uint32_t m = Mask( load32( p, end ) );
+      m = (want ? m : ~m) & validMask( end-p, 32 );
+      if( m )
+        return p + __builtin_ctz( m );
+    }
+    return end;
+  }
+
+  __attribute__((target("avx2")))
+  const char *nextTokenAVX2( const char  *begin,
+                             const char  *end,
+                             const char **tokenEnd )
+  {
+    const char *start = find32<spaceMask32>( begin, end, false );
+    *tokenEnd = find32<spaceMask32>( start, end, true );
+    return start;
+  }
+
+  __attribute__((target("avx2")))
+  const char *alnumRunAVX2( const char  *begin,
+                            const char  *end,
+                            const char **runEnd )
+  {
+    const char *start = find32<alnumMask32>( begin, end, true );
+    *runEnd = find32<alnumMask32>( start, end, false );
+    return start;
+  }
+
+  __attribute__((target("avx2")))
+  size_t normalizeAVX2( char *out, const char *begin, const char *end )
+  {
+    alignas(32) char lower[32];
+    char *o     = out;
+    bool  inRun = false;
+    for( const char *p = begin; p < end; p += 32 )
+    {
+      __m256i  v     = load32( p, end );
+      uint32_t valid = validMask( end-p, 32 );
+      uint32_t m     = alnumMask32( v ) & valid;
+      uint32_t from  = 0;
+      if( !inRun )
+      {
+        if( !m )
+          continue;
+        from  = __builtin_ctz( m );
+        inRun = true;
+      }
+
+      _mm256_store_si256( (__m256i*)lower,
+                          _mm256_or_si256( v, _mm256_set1_epi8( 0x20 ) ) );
+      uint32_t stop = ~m & valid & (~0u << from);
+      uint32_t to   = stop ? __builtin_ctz( stop ) : end-p < 32 ? end-p : 32;
+      memcpy( o, lower+from, to-from );
+      o += to-from;
+      if( stop )
+        break;
+    }
+    return o - out;
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  // Pick the kernels for the CPU we run on
+  //----------------------------------------------------------------------------
+  struct Kernels
+  {
+    typedef const char *(*FindFn)( const char*, const char*, const char** );
+    typedef size_t (*NormalizeFn)( char*, const char*, const char* );
+
+    Kernels()
+    {
+#ifdef LIBRARIAN_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports( "avx2" ) )
+      {
+        nextToken = nextTokenAVX2;
+        alnumRun  = alnumRunAVX2;
+        normalize = normalizeAVX2;
+        name      = "avx2";
+      }
+      else if( __builtin_cpu_supports( "sse2" ) )
+      {
+        nextToken = nextTokenSSE2;
+        alnumRun  = alnumRunSSE2;
+        normalize = normalizeSSE2;
+        name      = "sse2";
+      }
+#endif
+    }
+    FindFn       nextToken = nextTokenScalar;
+    FindFn       alnumRun  = alnumRunScalar;
+    NormalizeFn  normalize = normalizeScalar;
+    const char  *name      = "scalar";
+  };
+  const Kernels gKernels;
+}
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  // Find the next token
+  //----------------------------------------------------------------------------
+  const char *TextKernels::nextToken( const char  *begin,
+                                      const char  *end,
+                                      const char **tokenEnd )
+  {
+    return gKernels.nextToken( begin, end, tokenEnd );
+  }
+
+  //----------------------------------------------------------------------------
+  // Find the first run of alphanumeric characters
+  //----------------------------------------------------------------------------
+  const char *TextKernels::alnumRun( const char  *begin,
+                                     const char  *end,
+                                     const char **runEnd )
+  {
+    return gKernels.alnumRun( begin, end, runEnd );
+  }
+
+  //----------------------------------------------------------------------------
+  // Copy out the first run of alphanumeric characters lowercased
+  //----------------------------------------------------------------------------
+  size_t TextKernels::normalize( char *out, const char *begin, const char *end )
+  {
+    return gKernels.normalize( out, begin, end );
+  }
+
+  //----------------------------------------------------------------------------
+  // Name of the kernels
+  //----------------------------------------------------------------------------
+  const char *TextKernels::kernelName()
+  {
+    return gKernels.name;
+  }
+}
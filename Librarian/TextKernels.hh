@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2014 by Lukasz Janyst <ljanyst@buggybrain.net>
+//------------------------------------------------------------------------------
+// This file is part of the Librarian software suite.
+//
+// Librarian is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Librarian is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Librarian.  If not, see <http://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+
+namespace Librarian
+{
+  //----------------------------------------------------------------------------
+  //! Character classification kernels for tokenization and normalization
+  //!
+  //! The characters are classified the way the C locale does it: whitespace
+  //! is space, \t, \n, \v, \f and \r, and the alphanumeric characters are
+  //! the ASCII letters and digits; the bytes above 127 are neither. The
+  //! kernels look at 32 (AVX2) or 16 (SSE2) bytes at a time, the best
+  //! implementation the CPU supports is picked at run time.
+  //----------------------------------------------------------------------------
+  class TextKernels
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Find the next token, a run of characters other than whitespace
+      //!
+      //! @param begin    start of the input
+      //! @param end      end of the input
+      //! @param tokenEnd end of the token found
+      //! @return         start of the token or end if there is none
+      //------------------------------------------------------------------------
+      static const char *nextToken( const char  *begin,
+                                    const char  *end,
+                                    const char **tokenEnd );
+
+      //------------------------------------------------------------------------
+      //! Find the first run of alphanumeric characters
+      //!
+      //! @param begin  start of the input
+      //! @param end    end of the input
+      //! @param runEnd end of the run
+      //! @return       start of the run or end if there is none
+      //------------------------------------------------------------------------
+      static const char *alnumRun( const char  *begin,
+                                   const char  *end,
+                                   const char **runEnd );
+
+      //------------------------------------------------------------------------
+      //! Copy out the first run of alphanumeric characters lowercased, in a
+      //! single pass over the input
+      //!
+      //! @param out   output buffer, at least end-begin bytes long
+      //! @param begin start of the input
+      //! @param end   end of the input
+      //! @return      number of bytes written
+      //------------------------------------------------------------------------
+      static size_t normalize( char *out, const char *begin, const char *end );
+
+      //------------------------------------------------------------------------
+      //! Name of the kernels selected for this CPU
+      //------------------------------------------------------------------------
+      static const char *kernelName();
+  };
+}
@@ -19,6 +19,10 @@
 
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <Librarian/Tokenizer.hh>
 
@@ -29,6 +33,7 @@ namespace Librarian
   //----------------------------------------------------------------------------
   Status FileTokenizer::open( const std::string &uri )
   {
+    close();
     pStream = new std::ifstream( uri.c_str() );
     if( !pStream->is_open() )
       return Status( Status::errIO, strerror( errno ) );
@@ -43,4 +48,59 @@ namespace Librarian
     delete pStream;
     pStream = 0;
   }
+
+  //----------------------------------------------------------------------------
+  // Map a file for tokenization
+  //----------------------------------------------------------------------------
+  Status MappedTokenizer::open( const std::string &uri )
+  {
+    close();
+
+    int fd = ::open( uri.c_str(), O_RDONLY );
+    if( fd < 0 )
+      return Status( Status::errIO, strerror( errno ) );
+
+    struct stat st;
+    if( fstat( fd, &st ) )
+    {
+      Status status( Status::errIO, strerror( errno ) );
+      ::close( fd );
+      return status;
+    }
+
+    //--------------------------------------------------------------------------
+    // Empty files cannot be mapped and have no tokens anyway
+    //--------------------------------------------------------------------------
+    if( st.st_size == 0 )
+    {
+      ::close( fd );
+      return Status();
+    }
+
+    void *data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if( data == MAP_FAILED )
+      return Status( Status::errIO, strerror( errno ) );
+    madvise( data, st.st_size, MADV_SEQUENTIAL );
+
+    pData    = data;
+    pSize    = st.st_size;
+    pCurrent = (const char *)data;
+    pEnd     = pCurrent + pSize;
+    return Status();
+  }
+
+  //----------------------------------------------------------------------------
+  // Unmap the file
+  //----------------------------------------------------------------------------
+  void MappedTokenizer::close()
+  {
+    if( pData )
+      munmap( pData, pSize );
+    pData    = 0;
+    pSize    = 0;
+    pCurrent = 0;
+    pEnd     = 0;
+    pToken   = std::string_view();
+  }
 }
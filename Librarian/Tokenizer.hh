@@ -19,10 +19,13 @@
 
 #pragma once
 
+#include <cstddef>
 #include <fstream>
 #include <string>
+#include <string_view>
 
 #include <Librarian/Status.hh>
+#include <Librarian/TextKernels.hh>
 
 namespace Librarian
 {
@@ -48,9 +51,15 @@ namespace Librarian
       virtual bool loadNextToken() = 0;
 
       //------------------------------------------------------------------------
-      //! Get the current token
+      //! Get the current token, valid until the next token is loaded or
+      //! the resource is closed
+      //------------------------------------------------------------------------
+      virtual std::string_view getToken() const = 0;
+
       //------------------------------------------------------------------------
-      virtual const std::string &getToken() const = 0;
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~Tokenizer() {}
   };
 
   //----------------------------------------------------------------------------
@@ -85,13 +94,76 @@ namespace Librarian
       //------------------------------------------------------------------------
       //! Get the current token
       //------------------------------------------------------------------------
-      virtual const std::string &getToken() const
+      virtual std::string_view getToken() const
       {
         return pToken;
       }
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~FileTokenizer()
+      {
+        close();
+      }
+
     private:
       std::ifstream *pStream = 0;
       std::string    pToken;
   };
 
+  //----------------------------------------------------------------------------
+  //! Tokenize a file mapped to memory; the tokens are runs of characters
+  //! other than ASCII whitespace, found with the vector kernels, and point
+  //! into the mapping, so nothing is copied
+  //----------------------------------------------------------------------------
+  class MappedTokenizer: public Tokenizer
+  {
+    public:
+      //------------------------------------------------------------------------
+      //! Map a file for tokenization
+      //------------------------------------------------------------------------
+      virtual Status open( const std::string &uri );
+
+      //------------------------------------------------------------------------
+      //! Unmap the file
+      //------------------------------------------------------------------------
+      virtual void close();
+
+      //------------------------------------------------------------------------
+      //! Load next token
+      //------------------------------------------------------------------------
+      virtual bool loadNextToken()
+      {
+        const char *end;
+        const char *start = TextKernels::nextToken( pCurrent, pEnd, &end );
+        pToken   = std::string_view( start, end-start );
+        pCurrent = end;
+        return start != end;
+      }
+
+      //------------------------------------------------------------------------
+      //! Get the current token
+      //------------------------------------------------------------------------
+      virtual std::string_view getToken() const
+      {
+        return pToken;
+      }
+
+      //------------------------------------------------------------------------
+      //! Destructor
+      //------------------------------------------------------------------------
+      virtual ~MappedTokenizer()
+      {
+        close();
+      }
+
+    private:
+      void             *pData    = 0;
+      size_t            pSize    = 0;
+      const char       *pCurrent = 0;
+      const char       *pEnd     = 0;
+      std::string_view  pToken;
+  };
+
 }
@@ -22,7 +22,7 @@
 #include <vector>
 #include <string>
 
-#include <Librarian/Index.hh>
+#include <Librarian/SegmentedIndex.hh>
 #include <Librarian/QueryExecutor.hh>
 
 //------------------------------------------------------------------------------
@@ -34,7 +34,8 @@ namespace Param
   {
     Help    = 0,
     Run     = 1,
-    Invalid = 2
+    Explain = 2,
+    Invalid = 3
   };
 }
 
@@ -52,13 +53,39 @@ Param::Params processCommandLine( std::vector<std::string>  &params,
   if( command == "help" )
     return Param::Help;
 
-  if( command == "run" )
+  if( command == "run" || command == "explain" )
   {
-    if( argc != 4 )
+    std::string limit   = "0";
+    std::string analyze = "0";
+    int         first   = 2;
+    while( first < argc-2 )
+    {
+      std::string option = argv[first];
+      if( option == "-a" && command == "explain" )
+      {
+        analyze = "1";
+        ++first;
+      }
+      else if( option == "-l" )
+      {
+        limit = argv[first+1];
+        if( limit.empty() ||
+            limit.find_first_not_of( "0123456789" ) != std::string::npos )
+          return Param::Invalid;
+        first += 2;
+      }
+      else
+        return Param::Invalid;
+    }
+    if( argc != first+2 )
       return Param::Invalid;
-    params.push_back( argv[2] );
-    params.push_back( argv[3] );
-    return Param::Run;
+    params.push_back( argv[first] );
+    params.push_back( argv[first+1] );
+    params.push_back( limit );
+    if( command == "run" )
+      return Param::Run;
+    params.push_back( analyze );
+    return Param::Explain;
   }
 
   return Param::Invalid;
@@ -71,7 +98,20 @@ int help( const std::vector<std::string> &params )
 {
   std::cerr << "Usage:" << std::endl;
   std::cerr << "   help                 print this help message" << std::endl;
-  std::cerr << "   run index \"query\"    run a boolean query" << std::endl;
+  std::cerr << "   run [-l limit] index \"query\"" << std::endl;
+  std::cerr << "                        run a boolean query, the terms may ";
+  std::cerr << "use \"*\" and \"?\"" << std::endl;
+  std::cerr << "                        wildcards or end with \"~N\" to ";
+  std::cerr << "match within edit" << std::endl;
+  std::cerr << "                        distance N, expanding to at most ";
+  std::cerr << "limit terms each" << std::endl;
+  std::cerr << "   explain [-a] [-l limit] index \"query\"" << std::endl;
+  std::cerr << "                        print the execution plan of a query, ";
+  std::cerr << "picking it fills" << std::endl;
+  std::cerr << "                        the planned bitmaps and lists as a ";
+  std::cerr << "run would; with -a" << std::endl;
+  std::cerr << "                        run it and print what every operator ";
+  std::cerr << "did as well" << std::endl;
   return 0;
 }
 
@@ -80,11 +120,15 @@ int help( const std::vector<std::string> &params )
 //------------------------------------------------------------------------------
 int run( const std::vector<std::string> &params )
 {
-  Librarian::Index         index;
-  Librarian::QueryExecutor executor(&index);
-  std::deque<std::string>  results;
+  Librarian::SegmentedIndex index;
+  Librarian::QueryExecutor  executor(&index);
+  std::deque<std::string>   results;
 
-  Librarian::Status st = index.load( params[0] );
+  size_t limit = std::stoull( params[2] );
+  if( limit )
+    executor.setExpansionLimit( limit );
+
+  Librarian::Status st = index.open( params[0] );
   if( !st.isOK() )
   {
     std::cerr << "Unable to load index from " << params[0] << ": ";
@@ -105,6 +149,38 @@ int run( const std::vector<std::string> &params )
   return 0;
 }
 
+//------------------------------------------------------------------------------
+// Explain a query
+//------------------------------------------------------------------------------
+int explain( const std::vector<std::string> &params )
+{
+  Librarian::SegmentedIndex index;
+  Librarian::QueryExecutor  executor(&index);
+  std::string               plan;
+
+  size_t limit = std::stoull( params[2] );
+  if( limit )
+    executor.setExpansionLimit( limit );
+
+  Librarian::Status st = index.open( params[0] );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to load index from " << params[0] << ": ";
+    std::cerr << st.toString() << std::endl;
+    return 2;
+  }
+
+  st = executor.explain( plan, params[1], params[3] == "1" );
+  if( !st.isOK() )
+  {
+    std::cerr << "Unable to process query \"" << params[1] << "\": ";
+    std::cerr << st.toString() << std::endl;
+    return 2;
+  }
+  std::cout << plan;
+  return 0;
+}
+
 //------------------------------------------------------------------------------
 // The main show
 //------------------------------------------------------------------------------
@@ -122,6 +198,7 @@ int main( int argc, char **argv )
   std::vector<std::function<int(const std::vector<std::string>&)>> commands;
   commands.push_back( help );
   commands.push_back( run );
+  commands.push_back( explain );
 
   if( p >= commands.size() )
   {